@@ -0,0 +1,226 @@
+#include "Acquisition.h"
+
+#include "Log.h"
+#include "RealTimeSection.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+// default count of scans buffered between acquisition and processing, about two seconds
+static const size_t BLOCK_COUNT = 4096;
+// poll interval while the ring is full and the driver is not real time
+static const std::chrono::milliseconds RING_WAIT_TIME(1);
+
+const uint32_t JitterHistogram::LIMITS_US[BINS - 1] = {2, 5, 10, 20, 50, 100, 200, 500};
+
+std::string JitterHistogram::toString() const {
+    std::ostringstream out;
+    for (size_t bin = 0; bin < BINS; ++bin) {
+        if (bin < BINS - 1)
+            out << "<" << LIMITS_US[bin];
+        else
+            out << ">=" << LIMITS_US[bin - 1];
+        out << "us:" << m_counts[bin] << " ";
+    }
+    out << "max " << m_maxUs << "us, " << m_overruns << " overruns";
+    return out.str();
+}
+
+// the scans are paced on the clock of the sample times, see monotonicTime()
+static int64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+Acquisition::Acquisition(std::unique_ptr<AdcDriver> adc, const std::vector<std::vector<Command>> &cmds,
+                         const nlohmann::json &hardware)
+    : m_adc(std::move(adc)),
+      m_cmds(cmds),
+      m_blocks(hardware.value("acquisitionBlocks", BLOCK_COUNT)),
+      m_stop(false),
+      m_running(false),
+      m_active(true),
+      m_dropped(0),
+      m_jitterMaxUs(0),
+      m_overruns(0) {
+    for (auto &&count : m_jitterCounts) count = 0;
+
+    Log(INFO) << "acquisitionBlocks " << m_blocks.capacity();
+    m_scanPeriodUs = hardware.value("scanPeriodUs", 0);
+    m_scanSpinUs = hardware.value("scanSpinUs", 0);
+    if (m_scanSpinUs > m_scanPeriodUs) throw std::runtime_error("scanSpinUs needs to be shorter than scanPeriodUs");
+    Log(INFO) << "scanPeriodUs " << m_scanPeriodUs << " scanSpinUs " << m_scanSpinUs;
+    // leave the other cores to the processing, on a single core there is nothing to pin to
+    const int cpuCount = std::thread::hardware_concurrency();
+    m_cpu = hardware.value("acquisitionCpu", (cpuCount > 1) ? cpuCount - 1 : -1);
+    Log(INFO) << "acquisitionCpu " << m_cpu;
+
+    // allocate all blocks now, the real time thread must not allocate
+    size_t commandCount = 0;
+    for (auto &&chipCmds : m_cmds) commandCount += chipCmds.size();
+    for (size_t index = 0; index < m_blocks.capacity(); ++index) {
+        SampleBlock *block = m_blocks.back();
+        block->m_codes.reserve(commandCount);
+        block->m_times.reserve(commandCount);
+        m_blocks.push();
+    }
+    m_blocks.flush();
+    m_scratch.m_codes.reserve(commandCount);
+    m_scratch.m_times.reserve(commandCount);
+    m_adc->prepare(m_cmds);
+    m_chipOrder = m_adc->scanOrder(m_cmds.size());
+}
+
+Acquisition::~Acquisition() { stop(); }
+
+void Acquisition::start() {
+    if (m_thread) throw std::runtime_error("Acquisition already running");
+
+    m_adc->open();
+
+    m_stop = false;
+    m_running = true;
+    m_thread.reset(new std::thread(&Acquisition::threadFunction, this));
+}
+
+void Acquisition::stop() {
+    if (!m_thread) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_activeMutex);
+        m_stop = true;
+    }
+    m_activeChanged.notify_one();
+    m_thread->join();
+    m_thread.reset();
+
+    m_adc->close();
+}
+
+void Acquisition::pause() { m_active = false; }
+
+void Acquisition::resume() {
+    {
+        std::lock_guard<std::mutex> lock(m_activeMutex);
+        m_active = true;
+    }
+    m_activeChanged.notify_one();
+}
+
+JitterHistogram Acquisition::takeJitter() {
+    JitterHistogram histogram;
+    for (size_t bin = 0; bin < JitterHistogram::BINS; ++bin) histogram.m_counts[bin] = m_jitterCounts[bin].exchange(0);
+    histogram.m_maxUs = m_jitterMaxUs.exchange(0);
+    histogram.m_overruns = m_overruns.exchange(0);
+    return histogram;
+}
+
+void Acquisition::waitForDeadline(int64_t &deadlineNs) {
+    deadlineNs += (int64_t)m_scanPeriodUs * 1000;
+
+    // Sleep until shortly before the deadline, then spin to get below the wake up latency of the scheduler. There is
+    // no absolute sleep on CLOCK_MONOTONIC_RAW, the time left is slept on CLOCK_MONOTONIC. The rates of the clocks
+    // only differ by the NTP correction, the spin ends on the raw clock.
+    const int64_t sleepNs = deadlineNs - (int64_t)m_scanSpinUs * 1000 - monotonicNs();
+    if (sleepNs > 0) {
+        struct timespec remaining;
+        remaining.tv_sec = sleepNs / 1000000000;
+        remaining.tv_nsec = sleepNs % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, 0, &remaining, &remaining) == EINTR) {
+        }
+    }
+    int64_t nowNs = monotonicNs();
+    while (nowNs < deadlineNs) nowNs = monotonicNs();
+
+    uint64_t lateUs = (nowNs - deadlineNs) / 1000;
+    if (lateUs >= m_scanPeriodUs) {
+        // the last scan took too long, skip the deadlines which passed so the scans stay on the grid
+        const uint64_t skipped = lateUs / m_scanPeriodUs;
+        deadlineNs += (int64_t)(skipped * m_scanPeriodUs) * 1000;
+        lateUs -= skipped * m_scanPeriodUs;
+        m_overruns += skipped;
+    }
+
+    size_t bin = 0;
+    while ((bin < JitterHistogram::BINS - 1) && (lateUs >= JitterHistogram::LIMITS_US[bin])) ++bin;
+    m_jitterCounts[bin].fetch_add(1, std::memory_order_relaxed);
+    if (lateUs > m_jitterMaxUs.load(std::memory_order_relaxed)) m_jitterMaxUs = lateUs;
+}
+
+void Acquisition::threadFunction() {
+    // the thread stays on one core at real time priority, with all memory locked no page faults delay the reads
+    if (m_cpu >= 0) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(m_cpu, &cpuSet);
+        const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (result != 0) Log(WARN) << "Failed to pin the acquisition thread to CPU " << m_cpu << ": " << strerror(result);
+    }
+    // replayed or simulated samples gain nothing from real time priority, the thread waits for the processing
+    const bool realTime = m_adc->realTime();
+    if (realTime && (m_scanPeriodUs == 0) && (m_cpu < 0)) {
+        // unpaced scans never sleep, at real time priority they would starve the processing on a shared core
+        Log(WARN) << "Acquisition without scanPeriodUs or acquisitionCpu, not using real time priority";
+    } else if (realTime) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result != 0) Log(WARN) << "Failed to set real time priority: " << strerror(result);
+    }
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) Log(WARN) << "Failed to lock memory: " << strerror(errno);
+
+    try {
+        uint64_t sequence = 0;
+        int64_t deadlineNs = monotonicNs();
+        while (!m_stop) {
+            if (!m_active) {
+                std::unique_lock<std::mutex> lock(m_activeMutex);
+                m_activeChanged.wait(lock, [this] { return m_active || m_stop; });
+                // the deadlines passed while paused are not overruns
+                deadlineNs = monotonicNs();
+                continue;
+            }
+            if (!realTime && !m_blocks.back()) {
+                // recorded or simulated samples are not lost by waiting, drop nothing
+                std::this_thread::sleep_for(RING_WAIT_TIME);
+                continue;
+            }
+            if (m_scanPeriodUs != 0) waitForDeadline(deadlineNs);
+
+            RealTimeSection section;
+            SampleBlock *block = m_blocks.back();
+            if (!block) {
+                // the processing is behind, drop the scan but keep the converters busy so timing stays the same
+                for (auto &&chipID : m_chipOrder) {
+                    m_scratch.m_codes.clear();
+                    m_scratch.m_times.clear();
+                    m_adc->read(chipID, m_cmds[chipID], m_scratch.m_codes, m_scratch.m_times);
+                }
+                ++sequence;
+                ++m_dropped;
+                continue;
+            }
+
+            block->m_sequence = sequence++;
+            block->m_codes.clear();
+            block->m_times.clear();
+            for (auto &&chipID : m_chipOrder)
+                m_adc->read(chipID, m_cmds[chipID], block->m_codes, block->m_times);
+            m_blocks.push();
+        }
+    } catch (std::exception &e) {
+        Log(ERROR) << "Acquisition stopped: " << e.what();
+    }
+
+    munlockall();
+    m_running = false;
+}
@@ -0,0 +1,129 @@
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include "AdcDriver.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * The samples of one scan over all channels, in the order of the commands of the chips in Acquisition::chipOrder()
+ */
+struct SampleBlock {
+    // increments with each scan, a missing number means the scan was dropped
+    uint64_t m_sequence;
+    std::vector<uint16_t> m_codes;
+    std::vector<timeValueUs> m_times;
+};
+
+/**
+ * How late the paced scans started after their deadline
+ */
+struct JitterHistogram {
+    static const size_t BINS = 9;
+    // upper limits (exclusive) of the bins in us, the last bin takes the rest
+    static const uint32_t LIMITS_US[BINS - 1];
+
+    uint64_t m_counts[BINS];
+    uint32_t m_maxUs;
+    // deadlines skipped because a scan took longer than the scan period
+    uint64_t m_overruns;
+
+    std::string toString() const;
+};
+
+/**
+ * Reads the AD converters on a dedicated real time thread. The thread only fills sample blocks, the processing
+ * takes them from the ring at normal priority. If the ring is full the scan is dropped, unless the samples do not
+ * depend on the read time (AdcDriver::realTime()), then the thread waits for the processing.
+ *
+ * Without a scan period the scans follow each other as fast as the SPI allows. With a scan period each scan starts at
+ * an absolute deadline on CLOCK_MONOTONIC_RAW, the clock of the sample times. The samples of a channel are evenly
+ * spaced and the thread sleeps in between instead of spinning.
+ */
+class Acquisition {
+   public:
+    /**
+     * @param cmds for each chip the commands of one scan
+     * @param hardware settings, 'acquisitionCpu' selects the core the thread is pinned to (default: the last one,
+     *                 -1: no pinning), 'acquisitionBlocks' is the count of scans buffered, 'scanPeriodUs' the time
+     *                 from one scan start to the next (default 0: not paced), 'scanSpinUs' how long before the
+     *                 deadline the thread stops sleeping and busy-waits (default 0)
+     */
+    Acquisition(std::unique_ptr<AdcDriver> adc, const std::vector<std::vector<Command>> &cmds,
+                const nlohmann::json &hardware);
+    ~Acquisition();
+
+    void start();
+    void stop();
+
+    /**
+     * Suspend and continue the scans, the thread blocks while paused. Without continuous measurement the scans are
+     * only needed while a window is collected.
+     */
+    void pause();
+    void resume();
+
+    // false if the thread stopped because of an error
+    bool running() const { return m_running; }
+
+    SpscRing<SampleBlock> &blocks() { return m_blocks; }
+
+    // see AdcDriver::realTime()
+    bool realTime() const { return m_adc->realTime(); }
+
+    // count of dropped scans since the last call
+    uint64_t takeDropped() { return m_dropped.exchange(0); }
+
+    // log the events of the driver since the last call, see AdcDriver::logEvents()
+    void logEvents() { m_adc->logEvents(); }
+
+    // wall clock time of the sample time 'timeUs'
+    timeValueUs toWallTime(timeValueUs timeUs) const { return m_adc->toWallTime(timeUs); }
+
+    // the order in which the chips are read in a scan
+    const std::vector<uint32_t> &chipOrder() const { return m_chipOrder; }
+
+    // the core the thread is pinned to, -1 if not pinned
+    int cpu() const { return m_cpu; }
+
+    bool paced() const { return m_scanPeriodUs != 0; }
+    // the start jitter of the paced scans since the last call
+    JitterHistogram takeJitter();
+
+   private:
+    std::unique_ptr<AdcDriver> m_adc;
+    std::vector<std::vector<Command>> m_cmds;
+    std::vector<uint32_t> m_chipOrder;
+    int m_cpu;
+    uint32_t m_scanPeriodUs;
+    uint32_t m_scanSpinUs;
+
+    SpscRing<SampleBlock> m_blocks;
+    // receives the samples of dropped scans
+    SampleBlock m_scratch;
+
+    std::unique_ptr<std::thread> m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_active;
+    // wakes the paused thread
+    std::mutex m_activeMutex;
+    std::condition_variable m_activeChanged;
+    std::atomic<uint64_t> m_dropped;
+
+    // written by the acquisition thread, see JitterHistogram
+    std::atomic<uint64_t> m_jitterCounts[JitterHistogram::BINS];
+    std::atomic<uint32_t> m_jitterMaxUs;
+    std::atomic<uint64_t> m_overruns;
+
+    // wait for the next deadline (ns on CLOCK_MONOTONIC_RAW), 'deadlineNs' is advanced by the scan period
+    void waitForDeadline(int64_t &deadlineNs);
+    void threadFunction();
+};
+
+#endif  // ACQUISITION_H
@@ -0,0 +1,144 @@
+#include "AdcBcm2835.h"
+
+#include "Log.h"
+
+#include <bcm2835/bcm2835.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+// the first GPIO register covers these pins
+static const uint32_t MAX_GPIO_PIN = 31;
+
+AdcBcm2835::AdcBcm2835(const nlohmann::json &hardware) : m_muxMask(0), m_muxAddress(-1) {
+    static const nlohmann::json defaultChips = nlohmann::json::array({{{"cs", 0}}, {{"cs", 1}}});
+    const nlohmann::json chips = hardware.value("chips", defaultChips);
+    const std::vector<uint32_t> muxPins = hardware.value("muxPins", std::vector<uint32_t>());
+
+    for (auto &&pin : muxPins) {
+        if (pin > MAX_GPIO_PIN) throw std::runtime_error("Invalid mux pin " + std::to_string(pin));
+        m_muxPins.push_back(pin);
+        m_muxMask |= 1u << pin;
+    }
+
+    for (auto &&chip : chips) {
+        const int cs = chip.value("cs", 0);
+        if ((cs < 0) || (cs > 1)) throw std::runtime_error("Invalid chip select " + std::to_string(cs));
+        ChipSelect select;
+        select.m_cs = cs;
+        select.m_pin = 0;
+        select.m_address = 0;
+        if (chip.count("gpio")) {
+            const uint32_t pin = chip.at("gpio");
+            if (pin > MAX_GPIO_PIN) throw std::runtime_error("Invalid chip select pin " + std::to_string(pin));
+            select.m_type = ChipSelect::GPIO;
+            select.m_pin = pin;
+            Log(INFO) << "chip " << m_chipSelects.size() << " on GPIO " << pin;
+        } else if (chip.count("mux")) {
+            select.m_type = ChipSelect::MUX;
+            select.m_address = chip.at("mux");
+            if (select.m_address >= (1u << m_muxPins.size()))
+                throw std::runtime_error("Mux address " + std::to_string(select.m_address) + " needs more muxPins");
+            Log(INFO) << "chip " << m_chipSelects.size() << " on mux " << select.m_address << " CE" << (int)select.m_cs;
+        } else {
+            select.m_type = ChipSelect::HARDWARE;
+            Log(INFO) << "chip " << m_chipSelects.size() << " on CE" << (int)select.m_cs;
+        }
+        m_chipSelects.push_back(select);
+    }
+}
+
+void AdcBcm2835::open() {
+    if (!bcm2835_init()) throw std::runtime_error("Failed to init BCM 2835");
+
+    if (!bcm2835_spi_begin()) throw std::runtime_error("bcm2835_spi_begin() failed");
+
+    bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+    bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // Data comes in on falling
+                                                                  // edge
+    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_2048);  // 19.2MHz / 2048 = 9.375kHz
+    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
+    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS1, LOW);
+
+    // GPIO chip selects are active low, start deselected
+    for (auto &&select : m_chipSelects) {
+        if (select.m_type != ChipSelect::GPIO) continue;
+        bcm2835_gpio_fsel(select.m_pin, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_set(select.m_pin);
+    }
+    for (auto &&pin : m_muxPins) bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_OUTP);
+    m_muxAddress = -1;
+}
+
+void AdcBcm2835::close() {
+    bcm2835_spi_end();
+    if (!bcm2835_close()) throw std::runtime_error("bcm2835_close() failed");
+}
+
+void AdcBcm2835::prepare(const std::vector<std::vector<Command>> &cmds) {
+    if (cmds.size() > m_chipSelects.size())
+        throw std::runtime_error("No chip select for chip " + std::to_string(m_chipSelects.size()) +
+                                 ", add it to 'chips'");
+    AdcDriver::prepare(cmds);
+}
+
+void AdcBcm2835::read(uint32_t chipID, const std::vector<Command> &, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times) {
+    static const bcm2835SPIChipSelect cs[] = {BCM2835_SPI_CS0, BCM2835_SPI_CS1};
+
+    // select the chip
+    const ChipSelect &select = m_chipSelects[chipID];
+    if ((select.m_type == ChipSelect::MUX) && (select.m_address != m_muxAddress)) {
+        bcm2835_gpio_write_mask(muxBits(select.m_address), m_muxMask);
+        m_muxAddress = select.m_address;
+    }
+    const bool gpio = (select.m_type == ChipSelect::GPIO);
+    bcm2835_spi_chipSelect(gpio ? BCM2835_SPI_CS_NONE : cs[select.m_cs]);
+
+    ChipBuffers &chip = m_chips[chipID];
+    const timeValueUs startTimeUs = time();
+    // The MCP3008 starts a conversion on the falling edge of CS and transfernb() keeps CS asserted for the whole
+    // buffer, therefore the buffer is sent in slices of one command sequence.
+    for (size_t offset = 0; offset < chip.m_request.size(); offset += COMMAND_SIZE) {
+        if (gpio) bcm2835_gpio_clr(select.m_pin);
+        bcm2835_spi_transfernb(reinterpret_cast<char *>(&chip.m_request[offset]),
+                               reinterpret_cast<char *>(&chip.m_reply[offset]), COMMAND_SIZE);
+        if (gpio) bcm2835_gpio_set(select.m_pin);
+    }
+    const timeValueUs endTimeUs = time();
+
+    unpack(chipID, startTimeUs, endTimeUs, codes, times);
+}
+
+std::vector<uint32_t> AdcBcm2835::scanOrder(size_t chips) const {
+    // Position of a decoder address in the Gray code sequence, going through the addresses in this order changes
+    // one address pin from one chip to the next.
+    auto grayRank = [](uint32_t address) {
+        uint32_t rank = address;
+        for (uint32_t shift = 1; shift < 32; shift <<= 1) rank ^= rank >> shift;
+        return rank;
+    };
+    auto key = [&](uint32_t chipID) {
+        const ChipSelect &select = m_chipSelects[chipID];
+        switch (select.m_type) {
+            case ChipSelect::HARDWARE:
+                return std::make_tuple((int)select.m_type, (uint32_t)select.m_cs, 0u);
+            case ChipSelect::GPIO:
+                return std::make_tuple((int)select.m_type, (uint32_t)select.m_pin, 0u);
+            default:
+                return std::make_tuple((int)select.m_type, grayRank(select.m_address), (uint32_t)select.m_cs);
+        }
+    };
+
+    std::vector<uint32_t> order = AdcDriver::scanOrder(chips);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+    return order;
+}
+
+uint32_t AdcBcm2835::muxBits(uint32_t address) const {
+    uint32_t bits = 0;
+    for (size_t bit = 0; bit < m_muxPins.size(); ++bit)
+        if (address & (1u << bit)) bits |= 1u << m_muxPins[bit];
+    return bits;
+}
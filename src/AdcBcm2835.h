@@ -0,0 +1,52 @@
+#ifndef ADC_BCM2835_H
+#define ADC_BCM2835_H
+
+#include "AdcDriver.h"
+
+/**
+ * Access the AD converters with the BCM 2835 library
+ */
+class AdcBcm2835 : public AdcDriver {
+   public:
+    /**
+     * The chip select of each chip is set with 'chips' in the 'hardware' settings, one entry for each chip ID:
+     *   {"cs": 0}           the SPI chip select CE0 or CE1
+     *   {"gpio": 25}        a GPIO pin used as chip select
+     *   {"mux": 5, "cs": 1} a decoder (e.g. 74HC138) enabled by CE0 or CE1, the address is set on the GPIO pins
+     *                       listed in 'muxPins' (lowest bit first)
+     * The default are two chips on CE0 and CE1. An entry may also set the converter with "type": "MCP3008" (default)
+     * or "MCP3208".
+     */
+    explicit AdcBcm2835(const nlohmann::json &hardware);
+
+    virtual void open();
+    virtual void close();
+    virtual void prepare(const std::vector<std::vector<Command>> &cmds);
+    virtual void read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times);
+    virtual std::vector<uint32_t> scanOrder(size_t chips) const;
+
+   private:
+    struct ChipSelect {
+        enum Type { HARDWARE, GPIO, MUX };
+        Type m_type;
+        // CE0 or CE1 for HARDWARE and MUX
+        uint8_t m_cs;
+        // pin for GPIO
+        uint8_t m_pin;
+        // decoder address for MUX
+        uint32_t m_address;
+    };
+    std::vector<ChipSelect> m_chipSelects;
+
+    std::vector<uint8_t> m_muxPins;
+    // the bits of the mux pins in the GPIO register
+    uint32_t m_muxMask;
+    // address currently set on the mux pins, -1 if none
+    int64_t m_muxAddress;
+
+    // the GPIO register bits setting 'address' on the mux pins
+    uint32_t muxBits(uint32_t address) const;
+};
+
+#endif  // ADC_BCM2835_H
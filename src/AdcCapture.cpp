@@ -0,0 +1,119 @@
+#include "AdcCapture.h"
+
+#include "Log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+AdcCapture::AdcCapture(std::unique_ptr<AdcDriver> driver, const std::string &fileName, uint64_t records)
+    : m_driver(std::move(driver)),
+      m_fileName(fileName),
+      m_records(records),
+      m_fd(-1),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_scanRecords(0),
+      m_firstChipID(0),
+      m_skipped(0) {}
+
+AdcCapture::~AdcCapture() { unmap(); }
+
+void AdcCapture::unmap() {
+    if (!m_map) return;
+
+    msync(m_map, m_mapSize, MS_SYNC);
+    munmap(m_map, m_mapSize);
+    m_map = nullptr;
+    m_mapSize = 0;
+}
+
+void AdcCapture::open() {
+    m_driver->open();
+
+    m_fd = ::open(m_fileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd == -1) throw std::runtime_error("Failed to open " + m_fileName);
+
+    struct stat status;
+    if (fstat(m_fd, &status) != 0) throw std::runtime_error("Failed to get the size of " + m_fileName);
+
+    // the blocks are allocated now, writing to the map later neither grows the file nor runs out of space
+    const size_t fileSize = status.st_size;
+    const size_t size = std::max(fileSize, sizeof(CaptureFile::Header) + m_records * sizeof(CaptureFile::Record));
+    const int result = posix_fallocate(m_fd, 0, size);
+    if (result != 0) throw std::runtime_error("Failed to allocate " + m_fileName + ": " + strerror(result));
+
+    m_map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        throw std::runtime_error("Failed to map " + m_fileName);
+    }
+    m_mapSize = size;
+    m_skipped = 0;
+
+    CaptureFile::Header *fileHeader = header();
+    if ((fileSize >= sizeof(CaptureFile::Header)) &&
+        (memcmp(fileHeader->m_magic, CaptureFile::MAGIC, sizeof(CaptureFile::MAGIC)) == 0) &&
+        (fileHeader->m_recordSize == sizeof(CaptureFile::Record)) && (fileHeader->m_count <= capacity())) {
+        Log(INFO) << "Appending to capture file " << m_fileName << " with " << fileHeader->m_count << " samples";
+    } else {
+        if (fileSize != 0) Log(WARN) << "Overwriting invalid capture file " << m_fileName;
+        memcpy(fileHeader->m_magic, CaptureFile::MAGIC, sizeof(CaptureFile::MAGIC));
+        fileHeader->m_recordSize = sizeof(CaptureFile::Record);
+        fileHeader->m_reserved = 0;
+        fileHeader->m_count = 0;
+    }
+}
+
+void AdcCapture::prepare(const std::vector<std::vector<Command>> &cmds) {
+    m_driver->prepare(cmds);
+
+    m_scanRecords = 0;
+    for (auto &&chipCmds : cmds) m_scanRecords += chipCmds.size();
+    m_firstChipID = cmds.empty() ? 0 : m_driver->scanOrder(cmds.size()).front();
+}
+
+void AdcCapture::close() {
+    if (m_skipped) Log(WARN) << "Capture file " << m_fileName << " full, " << m_skipped << " samples not captured";
+    if (m_map) {
+        // cut the unused records
+        const size_t size = sizeof(CaptureFile::Header) + header()->m_count * sizeof(CaptureFile::Record);
+        unmap();
+        if (ftruncate(m_fd, size) != 0) Log(ERROR) << "Failed to truncate " << m_fileName;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_driver->close();
+}
+
+void AdcCapture::read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times) {
+    const size_t first = codes.size();
+    m_driver->read(chipID, cmds, codes, times);
+
+    // stop at the first scan which does not fit
+    const uint64_t count = header()->m_count;
+    if (m_skipped || ((chipID == m_firstChipID) && (count + m_scanRecords > capacity()))) {
+        m_skipped += cmds.size();
+        return;
+    }
+
+    CaptureFile::Record *record = records() + count;
+    for (size_t index = 0; index < cmds.size(); ++index, ++record) {
+        record->m_timeUs = times[first + index];
+        record->m_code = codes[first + index];
+        record->m_chipID = chipID;
+        record->m_channelID = cmds[index].m_channel;
+        record->m_reserved = 0;
+    }
+    // the count is updated last, so a crash leaves a valid file
+    header()->m_count = count + cmds.size();
+}
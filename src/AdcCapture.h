@@ -0,0 +1,57 @@
+#ifndef ADC_CAPTURE_H
+#define ADC_CAPTURE_H
+
+#include "AdcDriver.h"
+#include "CaptureFile.h"
+
+#include <string>
+
+/**
+ * Passes all requests to another driver and writes each sample read to a memory mapped capture file. Samples are
+ * appended if the file already exists. The file is allocated and mapped for all records when it is opened, the real
+ * time thread only writes to memory. Samples which do not fit are not captured.
+ */
+class AdcCapture : public AdcDriver {
+   public:
+    /**
+     * @param records capacity of the file, a larger existing file keeps its size
+     */
+    AdcCapture(std::unique_ptr<AdcDriver> driver, const std::string &fileName, uint64_t records);
+    virtual ~AdcCapture();
+
+    virtual void open();
+    virtual void close();
+    virtual void prepare(const std::vector<std::vector<Command>> &cmds);
+    virtual void read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times);
+
+    virtual void logEvents() { m_driver->logEvents(); }
+    virtual std::vector<uint32_t> scanOrder(size_t chips) const { return m_driver->scanOrder(chips); }
+    virtual bool realTime() const { return m_driver->realTime(); }
+    virtual timeValueUs time() const { return m_driver->time(); }
+    virtual timeValueUs toWallTime(timeValueUs timeUs) const { return m_driver->toWallTime(timeUs); }
+
+   private:
+    std::unique_ptr<AdcDriver> m_driver;
+    std::string m_fileName;
+    uint64_t m_records;
+
+    int m_fd;
+    void *m_map;
+    size_t m_mapSize;
+    // records of a scan and the chip which starts it, the file holds complete scans only
+    uint64_t m_scanRecords;
+    uint32_t m_firstChipID;
+    // samples read while the file was full
+    uint64_t m_skipped;
+
+    CaptureFile::Header *header() const { return static_cast<CaptureFile::Header *>(m_map); }
+    CaptureFile::Record *records() const { return reinterpret_cast<CaptureFile::Record *>(header() + 1); }
+
+    // record capacity of the mapped file
+    uint64_t capacity() const { return (m_mapSize - sizeof(CaptureFile::Header)) / sizeof(CaptureFile::Record); }
+
+    void unmap();
+};
+
+#endif  // ADC_CAPTURE_H
@@ -0,0 +1,94 @@
+#include "AdcDriver.h"
+
+#include "AdcCapture.h"
+#include "AdcReplay.h"
+#include "AdcSimulator.h"
+#include "AdcSpidev.h"
+#include "Log.h"
+
+#ifdef BCM2835
+#include "AdcBcm2835.h"
+#endif
+#ifdef WIRINGPI
+#include "AdcWiringPi.h"
+#endif
+
+#include <cstring>
+#include <stdexcept>
+
+// default size of the capture file, 64 MiB
+static const uint64_t CAPTURE_RECORDS = 4 * 1024 * 1024;
+
+std::unique_ptr<AdcDriver> AdcDriver::create(const nlohmann::json &hardware) {
+#ifdef BCM2835
+    static const std::string defaultDriver("bcm2835");
+#elif defined(WIRINGPI)
+    static const std::string defaultDriver("wiringpi");
+#elif defined(RPI)
+    static const std::string defaultDriver("spidev");
+#else
+    static const std::string defaultDriver("simulator");
+#endif
+    const std::string name = hardware.value("adcDriver", defaultDriver);
+    Log(INFO) << "adcDriver " << name;
+
+    std::unique_ptr<AdcDriver> driver;
+#ifdef BCM2835
+    if (name == "bcm2835") driver.reset(new AdcBcm2835(hardware));
+#endif
+#ifdef WIRINGPI
+    if (name == "wiringpi") driver.reset(new AdcWiringPi());
+#endif
+    if (name == "spidev") driver.reset(new AdcSpidev(hardware));
+    if (name == "simulator") driver.reset(new AdcSimulator(hardware));
+    if (name == "replay") driver.reset(new AdcReplay(hardware));
+
+    if (!driver) throw std::runtime_error("Unsupported ADC driver " + name);
+
+    // write the raw samples to a file
+    if (hardware.count("captureFile")) {
+        const std::string captureFile = hardware.at("captureFile");
+        const uint64_t captureRecords = hardware.value("captureRecords", CAPTURE_RECORDS);
+        Log(INFO) << "captureFile " << captureFile << " captureRecords " << captureRecords;
+        driver.reset(new AdcCapture(std::move(driver), captureFile, captureRecords));
+    }
+
+    return driver;
+}
+
+void AdcDriver::prepare(const std::vector<std::vector<Command>> &cmds) {
+    m_chips.resize(cmds.size());
+    for (size_t chipID = 0; chipID < cmds.size(); ++chipID) {
+        ChipBuffers &chip = m_chips[chipID];
+        chip.m_request.resize(cmds[chipID].size() * COMMAND_SIZE);
+        chip.m_reply.resize(chip.m_request.size());
+        for (size_t index = 0; index < cmds[chipID].size(); ++index)
+            memcpy(&chip.m_request[index * COMMAND_SIZE], cmds[chipID][index].m_data, COMMAND_SIZE);
+
+        // the decoding is selected once for each chip, not for each result
+        const AdcType type = cmds[chipID].empty() ? AdcType::MCP3008 : cmds[chipID].front().m_type;
+        for (auto &&cmd : cmds[chipID])
+            if (cmd.m_type != type) throw std::runtime_error("Commands for different AD converters on one chip");
+        chip.m_decode = (type == AdcType::MCP3208) ? decode<AdcType::MCP3208> : decode<AdcType::MCP3008>;
+    }
+}
+
+std::vector<uint32_t> AdcDriver::scanOrder(size_t chips) const {
+    std::vector<uint32_t> order(chips);
+    for (size_t chipID = 0; chipID < chips; ++chipID) order[chipID] = chipID;
+    return order;
+}
+
+void AdcDriver::unpack(uint32_t chipID, timeValueUs startTimeUs, timeValueUs endTimeUs, std::vector<uint16_t> &codes,
+                       std::vector<timeValueUs> &times) const {
+    const ChipBuffers &chip = m_chips[chipID];
+    const size_t count = chip.m_reply.size() / COMMAND_SIZE;
+    chip.m_decode(chip.m_reply.data(), count, codes);
+    for (size_t index = 0; index < count; ++index)
+        times.push_back(startTimeUs + ((endTimeUs - startTimeUs) * (index + 1)) / count);
+}
+
+template <AdcType TYPE>
+void AdcDriver::decode(const unsigned char *reply, size_t count, std::vector<uint16_t> &codes) {
+    for (size_t index = 0; index < count; ++index) codes.push_back(AdcTraits<TYPE>::decode(reply + index * COMMAND_SIZE));
+}
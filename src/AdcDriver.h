@@ -0,0 +1,97 @@
+#ifndef ADC_DRIVER_H
+#define ADC_DRIVER_H
+
+#include "Command.h"
+#include "Util.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Interface to the AD converters (MCP3008) of the energy meter
+ */
+class AdcDriver {
+   public:
+    virtual ~AdcDriver() {}
+
+    /**
+     * Create the driver selected with 'adcDriver' in the 'hardware' settings. Possible drivers are 'bcm2835',
+     * 'wiringpi' (if enabled at build time), 'spidev', 'simulator' and 'replay'. If 'captureFile' is set, the
+     * samples read are written to that file, up to 'captureRecords' samples.
+     */
+    static std::unique_ptr<AdcDriver> create(const nlohmann::json &hardware);
+
+    virtual void open() = 0;
+    virtual void close() = 0;
+
+    /**
+     * Build the transfer buffers for the scans, 'cmds' holds the commands of each chip. Called once before the
+     * first read().
+     */
+    virtual void prepare(const std::vector<std::vector<Command>> &cmds);
+
+    /**
+     * Send 'cmds' to chip 'chipID', the conversion results and their sample times are appended to 'codes' and
+     * 'times'. 'cmds' are the commands of the chip passed to prepare(). Runs on the real time thread and must not
+     * allocate memory, 'codes' and 'times' need to have room for the results.
+     */
+    virtual void read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times) = 0;
+
+    /**
+     * Log the events read() counted since the last call. read() runs on the real time thread and must not log
+     * itself, this is called from the processing thread.
+     */
+    virtual void logEvents() {}
+
+    /**
+     * The order in which the 'chips' chips are read in a scan, the default is by chip ID. Drivers order them to
+     * switch the chip selects as little as possible.
+     */
+    virtual std::vector<uint32_t> scanOrder(size_t chips) const;
+
+    /**
+     * False if the samples do not depend on the time they are read (replay, simulator). The acquisition then waits
+     * for the processing instead of dropping scans.
+     */
+    virtual bool realTime() const { return true; }
+
+    /**
+     * The current time in the time base of the sample times
+     */
+    virtual timeValueUs time() const { return monotonicTime(); }
+
+    /**
+     * Wall clock time of the sample time 'timeUs', used for the timestamps of published values. Must not touch the
+     * state used by read(), it is called from the processing thread.
+     */
+    virtual timeValueUs toWallTime(timeValueUs timeUs) const { return ClockMapping::getInstance().toWall(timeUs); }
+
+   protected:
+    /**
+     * Decode the conversion results from the reply of chip 'chipID', the sample times are spread evenly from
+     * 'startTimeUs' to 'endTimeUs'
+     */
+    void unpack(uint32_t chipID, timeValueUs startTimeUs, timeValueUs endTimeUs, std::vector<uint16_t> &codes,
+                std::vector<timeValueUs> &times) const;
+
+    static const size_t COMMAND_SIZE = sizeof(Command::m_data);
+
+    // append the 'count' results in 'reply' to 'codes'
+    using Decode = void (*)(const unsigned char *reply, size_t count, std::vector<uint16_t> &codes);
+    template <AdcType TYPE>
+    static void decode(const unsigned char *reply, size_t count, std::vector<uint16_t> &codes);
+
+    // the packed command sequences of one chip, the buffer for the reply and the decoding for the chip type
+    struct ChipBuffers {
+        std::vector<unsigned char> m_request;
+        std::vector<unsigned char> m_reply;
+        Decode m_decode;
+    };
+    std::vector<ChipBuffers> m_chips;
+};
+
+#endif  // ADC_DRIVER_H
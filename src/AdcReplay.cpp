@@ -0,0 +1,153 @@
+#include "AdcReplay.h"
+
+#include "Log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+// channels per chip
+static const uint32_t CHANNELS = 8;
+// The signal is not continuous when the replay restarts, a gap in the sample times makes the measurement start
+// again.
+static const timeValueUs RESTART_GAP_US = 1000000;
+
+AdcReplay::AdcReplay(const nlohmann::json &hardware)
+    : m_fileName(hardware.at("replayFile")),
+      m_fd(-1),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_records(nullptr),
+      m_count(0),
+      m_passes(0),
+      m_newPasses(0),
+      m_durationUs(0),
+      m_timeUs(0) {}
+
+AdcReplay::~AdcReplay() { close(); }
+
+void AdcReplay::open() {
+    m_fd = ::open(m_fileName.c_str(), O_RDONLY);
+    if (m_fd == -1) throw std::runtime_error("Failed to open " + m_fileName);
+
+    struct stat status;
+    if (fstat(m_fd, &status) != 0) throw std::runtime_error("Failed to get the size of " + m_fileName);
+    m_mapSize = status.st_size;
+    if (m_mapSize < sizeof(CaptureFile::Header)) throw std::runtime_error("Invalid capture file " + m_fileName);
+
+    m_map = mmap(nullptr, m_mapSize, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        throw std::runtime_error("Failed to map " + m_fileName);
+    }
+
+    const CaptureFile::Header *header = static_cast<const CaptureFile::Header *>(m_map);
+    if ((memcmp(header->m_magic, CaptureFile::MAGIC, sizeof(CaptureFile::MAGIC)) != 0) ||
+        (header->m_recordSize != sizeof(CaptureFile::Record)) ||
+        (sizeof(CaptureFile::Header) + header->m_count * sizeof(CaptureFile::Record) > m_mapSize) ||
+        (header->m_count == 0))
+        throw std::runtime_error("Invalid capture file " + m_fileName);
+
+    m_records = reinterpret_cast<const CaptureFile::Record *>(header + 1);
+    m_count = header->m_count;
+    std::fill(m_cursors.begin(), m_cursors.end(), 0);
+    std::fill(m_restarts.begin(), m_restarts.end(), 0);
+    m_passes = 0;
+
+    // a new segment starts where the time steps back, it continues after the end of the last one and a gap
+    m_segments.assign(1, Segment{0, 0});
+    timeValueUs endUs = m_records[0].m_timeUs;
+    for (uint64_t index = 1; index < m_count; ++index) {
+        const timeValueUs timeUs = m_records[index].m_timeUs;
+        if (timeUs < m_records[index - 1].m_timeUs)
+            m_segments.push_back(Segment{index, endUs + RESTART_GAP_US - timeUs});
+        endUs = timeUs + m_segments.back().m_offsetUs;
+    }
+    m_durationUs = endUs - m_records[0].m_timeUs + RESTART_GAP_US;
+    m_timeUs = m_records[0].m_timeUs;
+
+    Log(INFO) << "Replaying " << m_count << " samples from " << m_fileName;
+    if (m_segments.size() > 1)
+        Log(WARN) << "Sample times in " << m_fileName << " step back, replaying " << m_segments.size() << " segments";
+}
+
+void AdcReplay::close() {
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+        m_records = nullptr;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void AdcReplay::prepare(const std::vector<std::vector<Command>> &cmds) {
+    m_cursors.assign(cmds.size() * CHANNELS, 0);
+    m_restarts.assign(m_cursors.size(), 0);
+}
+
+bool AdcReplay::find(uint32_t chipID, uint32_t channelID, const CaptureFile::Record *&record) {
+    const size_t key = chipID * CHANNELS + channelID;
+    if (key >= m_cursors.size()) throw std::runtime_error("Chip not prepared for the replay");
+
+    uint64_t &cursor = m_cursors[key];
+    while (cursor < m_count) {
+        const CaptureFile::Record &candidate = m_records[cursor++];
+        if ((candidate.m_chipID == chipID) && (candidate.m_channelID == channelID)) {
+            record = &candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+timeValueUs AdcReplay::offset(const CaptureFile::Record *record) const {
+    const uint64_t index = record - m_records;
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), index,
+                               [](uint64_t index, const Segment &segment) { return index < segment.m_first; });
+    return (it - 1)->m_offsetUs;
+}
+
+void AdcReplay::logEvents() {
+    const uint64_t passes = m_newPasses.exchange(0);
+    if (passes) Log(DEBUG) << "Replay of " << m_fileName << " restarted (" << passes << "x)";
+}
+
+void AdcReplay::read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                     std::vector<timeValueUs> &times) {
+    if (!m_records) throw std::runtime_error("Replay file not open");
+
+    for (auto &&cmd : cmds) {
+        const uint32_t channelID = cmd.m_channel;
+
+        const CaptureFile::Record *record = nullptr;
+        const size_t key = chipID * CHANNELS + channelID;
+        if (!find(chipID, channelID, record)) {
+            // Start again, the times continue after the last sample and a gap. The channels restart when they reach
+            // their last sample, a capture holds complete scans so this happens in the same scan for all channels.
+            m_cursors[key] = 0;
+            if (++m_restarts[key] > m_passes) {
+                m_passes = m_restarts[key];
+                ++m_newPasses;
+            }
+
+            if (!find(chipID, channelID, record)) {
+                std::ostringstream msg;
+                msg << "No samples of " << chipID << ":" << channelID << " in " << m_fileName;
+                throw std::runtime_error(msg.str());
+            }
+        }
+
+        m_timeUs = record->m_timeUs + offset(record) + m_restarts[key] * m_durationUs;
+        codes.push_back(record->m_code);
+        times.push_back(m_timeUs);
+    }
+}
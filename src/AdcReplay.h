@@ -0,0 +1,65 @@
+#ifndef ADC_REPLAY_H
+#define ADC_REPLAY_H
+
+#include "AdcDriver.h"
+#include "CaptureFile.h"
+
+#include <atomic>
+#include <string>
+
+/**
+ * Reads the samples from a capture file written with AdcCapture. The samples are returned as fast as they are
+ * requested, the time follows the sample times in the file. At the end of the file the replay starts again. Where
+ * the sample times step back (samples appended to a capture after a reboot) the file is replayed in segments, each
+ * shifted to follow the last one after a gap.
+ */
+class AdcReplay : public AdcDriver {
+   public:
+    /**
+     * The file is set with 'replayFile' in the 'hardware' settings
+     */
+    explicit AdcReplay(const nlohmann::json &hardware);
+    virtual ~AdcReplay();
+
+    virtual void open();
+    virtual void close();
+    virtual void prepare(const std::vector<std::vector<Command>> &cmds);
+    virtual void read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times);
+    virtual void logEvents();
+
+    virtual bool realTime() const { return false; }
+    virtual timeValueUs time() const { return m_timeUs; }
+    // the replayed times are not related to the wall clock, the values are published with the current time
+    virtual timeValueUs toWallTime(timeValueUs) const { return ::time(); }
+
+   private:
+    std::string m_fileName;
+
+    int m_fd;
+    void *m_map;
+    size_t m_mapSize;
+    const CaptureFile::Record *m_records;
+    uint64_t m_count;
+
+    // position of the next record to search and count of restarts for each chip and channel
+    std::vector<uint64_t> m_cursors;
+    std::vector<uint64_t> m_restarts;
+    // most restarts of a channel, and the replays of the file since the last logEvents()
+    uint64_t m_passes;
+    std::atomic<uint64_t> m_newPasses;
+    // a run of rising sample times starting at record 'm_first', 'm_offsetUs' is added to its times (modulo 2^64)
+    struct Segment {
+        uint64_t m_first;
+        timeValueUs m_offsetUs;
+    };
+    std::vector<Segment> m_segments;
+    // duration of the file plus a gap, each restart adds it to the sample times
+    timeValueUs m_durationUs;
+    timeValueUs m_timeUs;
+
+    bool find(uint32_t chipID, uint32_t channelID, const CaptureFile::Record *&record);
+    timeValueUs offset(const CaptureFile::Record *record) const;
+};
+
+#endif  // ADC_REPLAY_H
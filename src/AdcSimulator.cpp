@@ -0,0 +1,77 @@
+#include "AdcSimulator.h"
+
+#include "Settings.h"
+
+#include <cmath>
+
+static const float PI = std::acos(-1.f);
+// amplitude of the voltage channel input, this is 230 V with the transformer ratio
+static const float VOLTAGE_AMPLITUDE = 1.372f;
+// amplitude of the first current channel input, the following channels are increased by this
+static const float CURRENT_AMPLITUDE = 0.06f;
+// the load angle increases by this for each current channel
+static const float LOAD_ANGLE = 5.f * PI / 180.f;
+// the CT sensor output lags the current, this is corrected by CAL_PHASE_CORRECTION in Power.cpp
+static const float CT_PHASE_LAG = 7.f * PI / 180.f;
+// the simulated time starts here, this leaves room for negative time offsets
+static const timeValueUs START_TIME_US = 1000000;
+// channels per chip
+static const uint32_t CHANNELS = 8;
+
+AdcSimulator::AdcSimulator(const nlohmann::json &hardware)
+    : m_refVoltage(hardware.at("refVoltage")),
+      m_adcOffsetVoltage(hardware.at("adcOffsetVoltage")),
+      m_timeUs(START_TIME_US),
+      m_noise(1) {
+    const nlohmann::json simulator = hardware.value("simulator", nlohmann::json::object());
+    m_frequency = simulator.value("frequency", 50.f);
+    m_transferTimeUs = simulator.value("transferTimeUs", 30);
+
+    auto &settings = Settings::getInstance();
+
+    // each line phase is shifted by 120 degree
+    auto voltageChannel = settings.get("voltageChannel");
+    const int voltagePhase = voltageChannel.at("phase");
+    Signal &voltage = signal(voltageChannel.at("chipID"), voltageChannel.at("channelID"));
+    voltage.m_amplitude = VOLTAGE_AMPLITUDE;
+    voltage.m_phase = -2.f * PI * (voltagePhase - 1) / 3.f;
+
+    uint32_t index = 0;
+    for (auto &channel : settings.get("currentChannels")) {
+        const int phase = channel.at("phase");
+        Signal &current = signal(channel.at("chipID"), channel.at("channelID"));
+        current.m_amplitude = CURRENT_AMPLITUDE * (index + 1);
+        current.m_phase = -2.f * PI * (phase - 1) / 3.f - LOAD_ANGLE * index - CT_PHASE_LAG;
+        ++index;
+    }
+}
+
+AdcSimulator::Signal &AdcSimulator::signal(uint32_t chipID, uint32_t channelID) {
+    const size_t index = chipID * CHANNELS + channelID;
+    if (index >= m_signals.size()) m_signals.resize(index + 1);
+    return m_signals[index];
+}
+
+void AdcSimulator::read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                        std::vector<timeValueUs> &times) {
+    for (auto &&cmd : cmds) {
+        m_timeUs += m_transferTimeUs;
+
+        const Signal &input = signal(chipID, cmd.m_channel);
+        const double periods = (double)(m_timeUs - START_TIME_US) * m_frequency / 1000000.0;
+        const float angle = 2.f * PI * (float)std::fmod(periods, 1.0) + input.m_phase;
+        const float voltage = input.m_amplitude * std::sin(angle) + m_adcOffsetVoltage;
+
+        // one bit of noise from a linear congruential generator
+        m_noise = m_noise * 1103515245 + 12345;
+        const int32_t noise = (int32_t)((m_noise >> 16) & 1);
+
+        const int32_t mask = adcMask(cmd.m_type);
+        int32_t code = (int32_t)(voltage / m_refVoltage * mask + 0.5f) + noise;
+        if (code < 0) code = 0;
+        if (code > mask) code = mask;
+
+        codes.push_back(code);
+        times.push_back(m_timeUs);
+    }
+}
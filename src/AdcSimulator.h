@@ -0,0 +1,51 @@
+#ifndef ADC_SIMULATOR_H
+#define ADC_SIMULATOR_H
+
+#include "AdcDriver.h"
+
+/**
+ * Deterministic simulation of the AD converters. The voltage channel gets a sine wave of the line voltage, each
+ * current channel a sine wave with an amplitude and load angle depending on its position in the settings. The
+ * simulation has its own clock which advances with each conversion, so it runs as fast as possible and each run
+ * gives the same samples.
+ */
+class AdcSimulator : public AdcDriver {
+   public:
+    /**
+     * The line frequency can be set with 'frequency' and the duration of a conversion with 'transferTimeUs' in the
+     * 'simulator' object of the 'hardware' settings
+     */
+    explicit AdcSimulator(const nlohmann::json &hardware);
+
+    virtual void open() {}
+    virtual void close() {}
+    virtual void read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times);
+
+    virtual bool realTime() const { return false; }
+    virtual timeValueUs time() const { return m_timeUs; }
+    // the simulated times are not related to the wall clock, the values are published with the current time
+    virtual timeValueUs toWallTime(timeValueUs) const { return ::time(); }
+
+   private:
+    struct Signal {
+        Signal() : m_amplitude(0.f), m_phase(0.f) {}
+        // amplitude at the AD input in volts
+        float m_amplitude;
+        float m_phase;
+    };
+    // the signal of each chip and channel
+    std::vector<Signal> m_signals;
+
+    float m_refVoltage;
+    float m_adcOffsetVoltage;
+    float m_frequency;
+    timeValueUs m_transferTimeUs;
+
+    timeValueUs m_timeUs;
+    uint32_t m_noise;
+
+    Signal &signal(uint32_t chipID, uint32_t channelID);
+};
+
+#endif  // ADC_SIMULATOR_H
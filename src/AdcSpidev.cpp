@@ -0,0 +1,80 @@
+#include "AdcSpidev.h"
+
+#include "Log.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+// default SPI clock
+static const uint32_t SPI_SPEED = 1 * 1000 * 1000;
+
+AdcSpidev::AdcSpidev(const nlohmann::json &hardware) : m_failedTransfers(0), m_transferError(0) {
+    static const std::vector<std::string> defaultDevices = {"/dev/spidev0.0", "/dev/spidev0.1"};
+    m_devices = hardware.value("spidevDevices", defaultDevices);
+    m_speed = hardware.value("spiSpeed", SPI_SPEED);
+}
+
+void AdcSpidev::open() {
+    for (auto &&device : m_devices) {
+        const int fd = ::open(device.c_str(), O_RDWR);
+        if (fd == -1) throw std::runtime_error("Failed to open " + device);
+        m_fds.push_back(fd);
+
+        uint8_t mode = SPI_MODE_0;
+        uint8_t bits = 8;
+        if ((ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0) || (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) ||
+            (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &m_speed) < 0))
+            throw std::runtime_error("Failed to setup " + device);
+    }
+}
+
+void AdcSpidev::close() {
+    for (auto &&fd : m_fds) ::close(fd);
+    m_fds.clear();
+}
+
+void AdcSpidev::prepare(const std::vector<std::vector<Command>> &cmds) {
+    AdcDriver::prepare(cmds);
+
+    // one message with a transfer for each command sequence, CS is toggled between the transfers
+    m_transfers.resize(cmds.size());
+    for (size_t chipID = 0; chipID < cmds.size(); ++chipID) {
+        ChipBuffers &chip = m_chips[chipID];
+        std::vector<struct spi_ioc_transfer> &transfers = m_transfers[chipID];
+        transfers.resize(cmds[chipID].size());
+        for (size_t index = 0; index < transfers.size(); ++index) {
+            auto &transfer = transfers[index];
+            memset(&transfer, 0, sizeof(transfer));
+            transfer.tx_buf = reinterpret_cast<uintptr_t>(&chip.m_request[index * COMMAND_SIZE]);
+            transfer.rx_buf = reinterpret_cast<uintptr_t>(&chip.m_reply[index * COMMAND_SIZE]);
+            transfer.len = COMMAND_SIZE;
+            transfer.cs_change = (index + 1 < transfers.size()) ? 1 : 0;
+        }
+    }
+}
+
+void AdcSpidev::logEvents() {
+    const uint64_t failed = m_failedTransfers.exchange(0, std::memory_order_acquire);
+    if (failed)
+        Log(ERROR) << failed << " SPI transfers failed: " << strerror(m_transferError.load(std::memory_order_relaxed));
+}
+
+void AdcSpidev::read(uint32_t chipID, const std::vector<Command> &, std::vector<uint16_t> &codes,
+                     std::vector<timeValueUs> &times) {
+    if (chipID >= m_fds.size()) throw std::runtime_error("No SPI device for chip");
+
+    const std::vector<struct spi_ioc_transfer> &transfers = m_transfers[chipID];
+    const timeValueUs startTimeUs = time();
+    if (ioctl(m_fds[chipID], SPI_IOC_MESSAGE(transfers.size()), transfers.data()) < 0) {
+        m_transferError.store(errno, std::memory_order_relaxed);
+        m_failedTransfers.fetch_add(1, std::memory_order_release);
+    }
+    const timeValueUs endTimeUs = time();
+
+    unpack(chipID, startTimeUs, endTimeUs, codes, times);
+}
@@ -0,0 +1,46 @@
+#ifndef ADC_SPIDEV_H
+#define ADC_SPIDEV_H
+
+#include "AdcDriver.h"
+
+#include <linux/spi/spidev.h>
+
+#include <atomic>
+#include <string>
+
+/**
+ * Access the AD converters with the Linux spidev driver, one device for each chip
+ */
+class AdcSpidev : public AdcDriver {
+   public:
+    /**
+     * The devices are set with 'spidevDevices' in the 'hardware' settings, the clock with 'spiSpeed'
+     */
+    explicit AdcSpidev(const nlohmann::json &hardware);
+
+    virtual void open();
+    virtual void close();
+    virtual void prepare(const std::vector<std::vector<Command>> &cmds);
+    virtual void read(uint32_t chipID, const std::vector<Command> &cmds, std::vector<uint16_t> &codes,
+                      std::vector<timeValueUs> &times);
+    virtual void logEvents();
+
+   protected:
+    AdcSpidev() : m_failedTransfers(0), m_transferError(0) {}
+
+    // file descriptor of the device of each chip
+    std::vector<int> m_fds;
+
+   private:
+    std::vector<std::string> m_devices;
+    uint32_t m_speed;
+
+    // for each chip a transfer for each command sequence
+    std::vector<std::vector<struct spi_ioc_transfer>> m_transfers;
+
+    // failed transfers since the last logEvents() and the errno of the last one
+    std::atomic<uint64_t> m_failedTransfers;
+    std::atomic<int> m_transferError;
+};
+
+#endif  // ADC_SPIDEV_H
@@ -0,0 +1,18 @@
+#include "AdcWiringPi.h"
+
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+
+#include <stdexcept>
+
+void AdcWiringPi::open() {
+    const int speed = 1 * 1000 * 1000;
+    if (wiringPiSetup() == -1) throw std::runtime_error("Failed to setup WiringPI");
+    int fd;
+    fd = wiringPiSPISetup(0, speed);
+    if (fd == -1) throw std::runtime_error("Failed to setup SPI channel 0");
+    m_fds.push_back(fd);
+    fd = wiringPiSPISetup(1, speed);
+    if (fd == -1) throw std::runtime_error("Failed to setup SPI channel 1");
+    m_fds.push_back(fd);
+}
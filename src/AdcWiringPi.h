@@ -0,0 +1,16 @@
+#ifndef ADC_WIRINGPI_H
+#define ADC_WIRINGPI_H
+
+#include "AdcSpidev.h"
+
+/**
+ * Access the AD converters with WiringPi, the transfers use the spidev devices opened by WiringPi
+ */
+class AdcWiringPi : public AdcSpidev {
+   public:
+    AdcWiringPi() {}
+
+    virtual void open();
+};
+
+#endif  // ADC_WIRINGPI_H
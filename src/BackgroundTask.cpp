@@ -50,11 +50,11 @@ void BackgroundTask::threadLoop()
         std::unique_lock<std::mutex> lock(cv_mutex);
         if (m_periodical)
         {
-            m_conditionVariable.wait_for(lock, Options::getInstance().updatePeriod());
+            m_conditionVariable.wait_for(lock, Options::getInstance().updatePeriod(), [this] { return m_stop.load(); });
         }
         else
         {
-            m_conditionVariable.wait(lock);
+            m_conditionVariable.wait(lock, [this] { return m_stop.load(); });
         }
     }
 }
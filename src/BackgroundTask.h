@@ -1,6 +1,7 @@
 #ifndef BACKGROUND_TASK_H
 #define BACKGROUND_TASK_H
 
+#include <atomic>
 #include <memory>
 #include <thread>
 #include <condition_variable>
@@ -21,7 +22,7 @@ private:
     std::condition_variable m_conditionVariable;
     std::mutex cv_mutex;
     bool m_periodical;
-    bool m_stop;
+    std::atomic<bool> m_stop;
 
     void threadLoop();
 
@@ -29,6 +30,12 @@ protected:
     virtual void preStart() { };
     virtual void postStop() { };
     virtual void threadFunction() = 0;
+
+    // a long running threadFunction() needs to return when this is set
+    bool stopRequested() const
+    {
+        return m_stop;
+    }
 };
 
 #endif // BACKGROUND_TASK_H
@@ -0,0 +1,511 @@
+#include "Benchmark.h"
+
+#include "Channel.h"
+#include "Integrator.h"
+#include "PowerKernel.h"
+#include "SolarMax.h"
+#include "WorkerPool.h"
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// length of the sample window, 22 periods at 50 Hz
+static const timeValueUs WINDOW_TIME_US = 22 * 20000;
+// the start time of the window, leaves room for negative time offsets
+static const timeValueUs START_TIME_US = 1000000;
+
+/**
+ * Call 'function' and return the time it took in milliseconds
+ */
+template <typename F>
+static double measureMs(F function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * Fill a voltage and a current channel with 'samples' samples of a 50 Hz sine wave. The current samples are taken
+ * shortly after the voltage samples as it is done when scanning the channels. The channels need to be created with
+ * offset -0.5 and factor 2 to get values of -1...1.
+ */
+static void fillChannels(size_t samples, ChannelAD &voltage, ChannelAD &current) {
+    const float omega = 2.f * std::acos(-1.f) * 50.f / 1000000.f;
+    auto code = [](float value) { return (uint16_t)std::lround((value + 1.f) * 0.5f * AdcTraits<AdcType::MCP3008>::MASK); };
+    for (size_t index = 0; index < samples; ++index) {
+        const timeValueUs time = START_TIME_US + (index * WINDOW_TIME_US) / samples;
+        voltage.setSample(time, code(std::sin(omega * time)));
+        current.setSample(time + 5, code(std::sin(omega * (time + 5))));
+    }
+}
+
+static void benchmarkResampler() {
+    std::cout << "Voltage interpolation at each current sample time" << std::endl;
+    std::cout << std::setw(10) << "samples" << std::setw(14) << "search [ms]" << std::setw(14) << "cursor [ms]"
+              << std::setw(10) << "speedup" << std::endl;
+
+    const size_t sampleCounts[] = {1000, 10000, 100000};
+    for (auto samples : sampleCounts) {
+        ChannelAD voltage("voltage", 0, 0, -0.5f, 2.f);
+        ChannelAD current("current", 0, 1, -0.5f, 2.f);
+        fillChannels(samples, voltage, current);
+
+        // the phase correction moves the voltage time a bit
+        const timeValueUs timeOffsetUs = 390;
+
+        float searchSum = 0.f;
+        const double searchMs = measureMs([&] {
+            for (size_t index = 0; index < current.sampleCount(); ++index)
+                searchSum += voltage.sampleAtTime(current.sampleTime(index) - timeOffsetUs);
+        });
+
+        float cursorSum = 0.f;
+        const double cursorMs = measureMs([&] {
+            size_t cursor = 0;
+            for (size_t index = 0; index < current.sampleCount(); ++index)
+                cursorSum += voltage.sampleAtTime(current.sampleTime(index) - timeOffsetUs, cursor);
+        });
+
+        std::cout << std::setw(10) << samples << std::fixed << std::setprecision(3) << std::setw(14) << searchMs
+                  << std::setw(14) << cursorMs << std::setprecision(1) << std::setw(9) << searchMs / cursorMs << "x"
+                  << std::endl;
+        if (searchSum != cursorSum) std::cout << "  Error: results differ " << searchSum << " " << cursorSum << std::endl;
+    }
+}
+
+static const timeValueUs PERIOD_US = 20000;
+
+// peak of the fixed point samples, see ChannelAD::fixed()
+static const float FIXED_PEAK = 0.5f * (1 << 14);
+
+/**
+ * The samples of one window of 'channels' current channels and a voltage channel, 'scanTimeUs' is the time between
+ * two samples of a channel
+ */
+struct WindowSamples {
+    WindowSamples(size_t channels, timeValueUs scanTimeUs, uint32_t periods) : m_channels(channels) {
+        const float omega = 2.f * std::acos(-1.f) / PERIOD_US;
+        const timeValueUs sampleTimeUs = scanTimeUs / (channels + 1);
+        for (timeValueUs time = START_TIME_US; time < START_TIME_US + (periods + 4) * PERIOD_US; time += scanTimeUs) {
+            m_times.push_back(time);
+            m_values.push_back((int16_t)std::lround(FIXED_PEAK * std::sin(omega * time)));
+            for (size_t channel = 0; channel < channels; ++channel) {
+                const timeValueUs currentTime = time + (channel + 1) * sampleTimeUs;
+                m_times.push_back(currentTime);
+                m_values.push_back((int16_t)std::lround(0.5f * FIXED_PEAK * std::sin(omega * currentTime - 0.1f)));
+            }
+        }
+    }
+
+    size_t m_channels;
+    // for each scan the voltage sample followed by the current samples
+    std::vector<timeValueUs> m_times;
+    std::vector<int16_t> m_values;
+};
+
+/**
+ * Integrate one window as Power::update() does, the power of each channel is written to 'powers'
+ */
+static void integrateWindow(const WindowSamples &samples, uint32_t periods, std::vector<float> &powers) {
+    VoltageDelayLine delayLine(4096);
+    ZeroCrossingDetector detector(std::lround(FIXED_PEAK * 0.1f));
+    std::vector<PowerIntegrator> integrators(samples.m_channels,
+                                             PowerIntegrator(-(int64_t)PERIOD_US - 400, 325.f / FIXED_PEAK, 1.f));
+    for (auto &&integrator : integrators) integrator.start(periods);
+
+    const timeValueUs startSampleTimeUs = START_TIME_US + 2 * PERIOD_US;
+    for (size_t index = 0; index < samples.m_times.size(); index += samples.m_channels + 1) {
+        delayLine.push(samples.m_times[index], samples.m_values[index]);
+        if (detector.add(samples.m_times[index], samples.m_values[index]) &&
+            (detector.crossingTime() >= startSampleTimeUs)) {
+            for (auto &&integrator : integrators) integrator.markPeriod(detector.crossingTime());
+        }
+        for (size_t channel = 0; channel < samples.m_channels; ++channel)
+            integrators[channel].add(samples.m_times[index + 1 + channel], samples.m_values[index + 1 + channel],
+                                     delayLine);
+    }
+
+    powers.clear();
+    for (auto &&integrator : integrators) powers.push_back(integrator.power());
+}
+
+/**
+ * Integrate one window as Power::update() does with 'pool': the voltage of the whole window goes to the delay line
+ * first, then the current channels are integrated in parallel
+ */
+static void integrateWindowParallel(const WindowSamples &samples, uint32_t periods, WorkerPool &pool,
+                                    std::vector<float> &powers) {
+    const size_t scans = samples.m_times.size() / (samples.m_channels + 1);
+    VoltageDelayLine delayLine(scans);
+    ZeroCrossingDetector detector(std::lround(FIXED_PEAK * 0.1f));
+    std::vector<PowerIntegrator> integrators(samples.m_channels,
+                                             PowerIntegrator(-(int64_t)PERIOD_US - 400, 325.f / FIXED_PEAK, 1.f));
+    for (auto &&integrator : integrators) integrator.start(periods);
+
+    const timeValueUs startSampleTimeUs = START_TIME_US + 2 * PERIOD_US;
+    std::vector<timeValueUs> marks;
+    for (size_t index = 0; index < samples.m_times.size(); index += samples.m_channels + 1) {
+        delayLine.push(samples.m_times[index], samples.m_values[index]);
+        if (detector.add(samples.m_times[index], samples.m_values[index]) &&
+            (detector.crossingTime() >= startSampleTimeUs))
+            marks.push_back(detector.crossingTime());
+    }
+
+    pool.run(samples.m_channels, [&](size_t channel) {
+        // the integrator takes a few marks ahead of its samples, the marks of the window are added as they are due
+        PowerIntegrator &integrator = integrators[channel];
+        size_t mark = 0;
+        for (size_t index = 1 + channel; index < samples.m_times.size(); index += samples.m_channels + 1) {
+            const timeValueUs time = samples.m_times[index];
+            while ((mark < marks.size()) && (marks[mark] <= time)) integrator.markPeriod(marks[mark++]);
+            integrator.add(time, samples.m_values[index], delayLine);
+        }
+    });
+
+    powers.clear();
+    for (auto &&integrator : integrators) powers.push_back(integrator.power());
+}
+
+static void benchmarkParallelIntegration() {
+    static const size_t CHANNELS = 13;
+    static const uint32_t PERIODS = 50;
+    static const size_t REPEAT = 5;
+    static const timeValueUs SCAN_TIME_US = 35;
+
+    const WindowSamples samples(CHANNELS, SCAN_TIME_US, PERIODS);
+    std::cout << "Power integration of " << CHANNELS << " channels over " << PERIODS << " periods on the worker pool"
+              << std::endl;
+    std::cout << std::setw(12) << "workers" << std::setw(14) << "time [ms]" << std::setw(10) << "speedup"
+              << std::endl;
+
+    // the marks are known before the current samples, so the result differs slightly from integrateWindow()
+    std::vector<float> singlePowers;
+    double singleMs = 0.0;
+    const size_t cpuCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t workers = 0; workers < cpuCount; ++workers) {
+        WorkerPool pool(workers);
+        std::vector<float> powers;
+        const double ms = measureMs([&] {
+                              for (size_t repeat = 0; repeat < REPEAT; ++repeat)
+                                  integrateWindowParallel(samples, PERIODS, pool, powers);
+                          }) /
+                          REPEAT;
+        if (workers == 0) {
+            singleMs = ms;
+            singlePowers = powers;
+        }
+
+        std::cout << std::setw(12) << workers << std::fixed << std::setprecision(3) << std::setw(14) << ms
+                  << std::setprecision(1) << std::setw(9) << singleMs / ms << "x" << std::endl;
+        if (memcmp(singlePowers.data(), powers.data(), powers.size() * sizeof(float)) != 0)
+            std::cout << "  Error: results differ from the single thread" << std::endl;
+    }
+}
+
+static void benchmarkIntegration() {
+    static const size_t CHANNELS = 13;
+    static const uint32_t PERIODS = 5;
+    static const size_t REPEAT = 20;
+
+    std::cout << "Power integration of " << CHANNELS << " channels over one window, kernels scalar and "
+              << PowerKernel::simdName << (PowerKernel::simdSupported() ? "" : " (not supported)") << std::endl;
+    std::cout << std::setw(12) << "scan [us]" << std::setw(14) << "scalar [ms]" << std::setw(14) << "simd [ms]"
+              << std::setw(10) << "speedup" << std::endl;
+
+    const timeValueUs scanTimes[] = {560, 140, 35};
+    for (auto scanTimeUs : scanTimes) {
+        const WindowSamples samples(CHANNELS, scanTimeUs, PERIODS);
+        std::vector<float> scalarPowers;
+        std::vector<float> simdPowers;
+
+        PowerKernel::select(false);
+        integrateWindow(samples, PERIODS, scalarPowers);
+        const double scalarMs = measureMs([&] {
+                                    for (size_t repeat = 0; repeat < REPEAT; ++repeat)
+                                        integrateWindow(samples, PERIODS, scalarPowers);
+                                }) /
+                                REPEAT;
+        PowerKernel::select(true);
+        const double simdMs = measureMs([&] {
+                                  for (size_t repeat = 0; repeat < REPEAT; ++repeat)
+                                      integrateWindow(samples, PERIODS, simdPowers);
+                              }) /
+                              REPEAT;
+
+        std::cout << std::setw(12) << scanTimeUs << std::fixed << std::setprecision(3) << std::setw(14) << scalarMs
+                  << std::setw(14) << simdMs << std::setprecision(1) << std::setw(9) << scalarMs / simdMs << "x"
+                  << std::endl;
+        if (memcmp(scalarPowers.data(), simdPowers.data(), scalarPowers.size() * sizeof(float)) != 0)
+            std::cout << "  Error: results of the kernels differ" << std::endl;
+    }
+
+    // the kernel alone
+    std::vector<int16_t> voltage(1 << 20);
+    std::vector<int16_t> current(voltage.size());
+    std::vector<int32_t> time(voltage.size(), 30);
+    for (size_t index = 0; index < voltage.size(); ++index) {
+        voltage[index] = (int16_t)std::lround(FIXED_PEAK * std::sin(index * 0.01f));
+        current[index] = (int16_t)std::lround(-FIXED_PEAK * std::sin(index * 0.01f - 0.1f));
+    }
+    int64_t scalarSums[3] = {0, 0, 0};
+    int64_t simdSums[3] = {0, 0, 0};
+    const double scalarMs = measureMs([&] {
+        for (size_t index = 0; index < voltage.size(); index += 64)
+            PowerKernel::scalar(&voltage[index], &current[index], &time[index], 64, scalarSums);
+    });
+    const double simdMs = measureMs([&] {
+        for (size_t index = 0; index < voltage.size(); index += 64)
+            PowerKernel::simd(&voltage[index], &current[index], &time[index], 64, simdSums);
+    });
+    std::cout << "Kernel only, " << voltage.size() << " samples: scalar " << std::setprecision(3) << scalarMs
+              << " ms, simd " << simdMs << " ms, speedup " << std::setprecision(1) << scalarMs / simdMs << "x"
+              << std::endl;
+    if (memcmp(scalarSums, simdSums, sizeof(scalarSums)) != 0)
+        std::cout << "  Error: results of the kernels differ" << std::endl;
+}
+
+// keeps the compiler from dropping the clock calls
+static volatile uint64_t s_clockSink;
+
+/**
+ * Print the time per call of 'clock' in nanoseconds
+ */
+template <typename F>
+static void measureClock(const char *name, F clock) {
+    static const size_t CALLS = 1000000;
+
+    uint64_t sum = 0;
+    const double ms = measureMs([&] {
+        for (size_t call = 0; call < CALLS; ++call) sum += clock();
+    });
+    s_clockSink = sum;
+    std::cout << std::setw(26) << name << std::fixed << std::setprecision(1) << std::setw(10)
+              << ms * 1000000.0 / CALLS << std::endl;
+}
+
+static uint64_t clockGettime(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void benchmarkClocks() {
+    std::cout << "Time stamps, each sample is stamped with the sample clock" << std::endl;
+    std::cout << std::setw(26) << "clock" << std::setw(10) << "[ns/call]" << std::endl;
+
+    measureClock("time() (gettimeofday)", [] { return time(); });
+    measureClock("monotonicTime() (RAW)", [] { return monotonicTime(); });
+    measureClock("CLOCK_MONOTONIC", [] { return clockGettime(CLOCK_MONOTONIC); });
+    measureClock("CLOCK_MONOTONIC_COARSE", [] { return clockGettime(CLOCK_MONOTONIC_COARSE); });
+#if defined(__aarch64__)
+    measureClock("cntvct_el0 (counter)", [] {
+        uint64_t count;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(count));
+        return count;
+    });
+#elif defined(__x86_64__) || defined(__i386__)
+    measureClock("rdtsc (counter)", [] { return (uint64_t)__rdtsc(); });
+#endif
+
+    ClockMapping &mapping = ClockMapping::getInstance();
+    const double calibrateMs = measureMs([&] { mapping.calibrate(); });
+    std::cout << "Mapping to the wall clock: calibration " << std::setprecision(3) << calibrateMs * 1000.0
+              << " us, uncertainty " << mapping.uncertainty() << " us" << std::endl;
+}
+
+/**
+ * The stream based SolarMax frame encoding and parsing used before SolarMax::encodeRequest() and
+ * SolarMax::parseReply(), kept as reference for the benchmark
+ */
+namespace StreamCodec {
+
+static std::string buildMessage(const std::vector<std::string> &codes, uint32_t dst) {
+    std::ostringstream data;
+    bool first = true;
+    for (auto &&code : codes) {
+        if (!first) data << ";";
+        first = false;
+        data << code;
+    }
+
+    const uint32_t src = 0xFB;
+    const size_t len = 19 + data.str().length();
+
+    std::ostringstream checksumMsg;
+    checksumMsg << std::setfill('0') << std::hex << std::uppercase << std::setw(2) << src << ";" << std::setfill('0')
+                << std::hex << std::uppercase << std::setw(2) << dst << ";" << std::setfill('0') << std::hex
+                << std::uppercase << std::setw(2) << len << "|64:" << data.str() << "|";
+
+    uint16_t checksum = 0;
+    for (auto &&c : checksumMsg.str()) checksum += c;
+
+    std::ostringstream msg;
+    msg << "{" << checksumMsg.str() << std::setfill('0') << std::hex << std::uppercase << std::setw(4) << checksum
+        << "}";
+    return msg.str();
+}
+
+// the raw value of a scalar code or the error code of an error record, the statistics codes are parsed but not
+// returned
+static uint32_t parseValue(const std::string &code, const std::string &string) {
+    uint32_t ivalue = 0;
+    if (code.compare(0, 2, "DD") == 0) {
+        uint32_t year, month, day, power, max, hours;
+        size_t index = 0;
+        std::istringstream(string.substr(index, 3)) >> std::hex >> year;
+        index += 3;
+        std::istringstream(string.substr(index, 2)) >> std::hex >> month;
+        index += 2;
+        std::istringstream(string.substr(index, 2)) >> std::hex >> day;
+        index += 3;
+        std::istringstream(string.substr(index)) >> std::hex >> power;
+        index = string.find_first_of(',', index) + 1;
+        std::istringstream(string.substr(index)) >> std::hex >> max;
+        index = string.find_first_of(',', index) + 1;
+        std::istringstream(string.substr(index)) >> std::hex >> hours;
+    } else if (code.compare(0, 2, "EC") == 0) {
+        // the date and the seconds of the day precede the error code
+        size_t index = string.find_first_of(',') + 1;
+        index = string.find_first_of(',', index) + 1;
+        std::istringstream(string.substr(index)) >> std::hex >> ivalue;
+    } else {
+        std::istringstream(string) >> std::hex >> ivalue;
+    }
+    return ivalue;
+}
+
+static void parseReply(uint32_t src, const std::string &reply, const std::vector<std::string> &codes,
+                       std::vector<uint32_t> &values) {
+    std::ostringstream expected;
+    expected << "{" << std::setfill('0') << std::hex << std::uppercase << std::setw(2) << src << ";"
+             << std::setfill('0') << std::hex << std::uppercase << std::setw(2) << 0xFB << ";";
+
+    size_t index = 0;
+    if (reply.compare(index, expected.str().length(), expected.str()) != 0)
+        throw std::runtime_error("Unexpected reply");
+    index += expected.str().length() + 2;
+
+    const std::string delimiter("|64:");
+    if (reply.compare(index, delimiter.length(), delimiter) != 0) throw std::runtime_error("Unexpected reply");
+    index += delimiter.length();
+
+    values.clear();
+    for (auto &&code : codes) {
+        if (reply.compare(index, code.length(), code) != 0) throw std::runtime_error("Unexpected reply");
+        index += code.length() + 1;
+        values.push_back(parseValue(code, reply.substr(index)));
+
+        size_t newIndex = reply.find_first_of(';', index);
+        if (newIndex == std::string::npos) newIndex = reply.find_first_of('|', index);
+        index = newIndex + 1;
+    }
+}
+
+}  // namespace StreamCodec
+
+/**
+ * Encode the requests and parse the recorded replies of converters with the stream based and the in place codec
+ */
+static void benchmarkSolarMaxCodec() {
+    static const size_t REPEAT = 20000;
+
+    struct Exchange {
+        uint32_t address;
+        std::vector<std::string> codes;
+        std::string reply;
+    };
+    const std::vector<Exchange> exchanges = {
+        {1, {"PAC", "KDY"}, "{01;FB;21|64:PAC=1F4;KDY=2A|06ED}"},
+        {2, {"PAC", "KDY"}, "{02;FB;22|64:PAC=B5E;KDY=12C|0733}"},
+        {3,
+         {"UDC", "IDC", "UL1", "IL1", "TNF", "PAC"},
+         "{03;FB;42|64:UDC=BB8;IDC=1F4;UL1=8FC;IL1=6E;TNF=1388;PAC=A8C|0F2B}"},
+        {1, {"DD00"}, "{01;FB;29|64:DD00=7E20A12,2A,1F4,5A|0825}"},
+        {2, {"EC00"}, "{02;FB;2E|64:EC00=7DB0C1A,EA5D,20004,0,0|093F}"},
+    };
+
+    std::vector<std::vector<std::unique_ptr<SolarMax::Value>>> values(exchanges.size());
+    std::vector<std::vector<SolarMax::Value *>> valuePointers(exchanges.size());
+    for (size_t index = 0; index < exchanges.size(); ++index) {
+        for (auto &&code : exchanges[index].codes) {
+            values[index].emplace_back(new SolarMax::Value(code));
+            valuePointers[index].push_back(values[index].back().get());
+        }
+    }
+
+    std::cout << "SolarMax request encoding and reply parsing, " << exchanges.size() << " recorded replies"
+              << std::endl;
+
+    size_t sink = 0;
+    std::vector<uint32_t> streamValues;
+    const double streamMs = measureMs([&] {
+        for (size_t repeat = 0; repeat < REPEAT; ++repeat) {
+            for (auto &&exchange : exchanges) {
+                sink += StreamCodec::buildMessage(exchange.codes, exchange.address).size();
+                StreamCodec::parseReply(exchange.address, exchange.reply, exchange.codes, streamValues);
+            }
+        }
+    });
+
+    const double inPlaceMs = measureMs([&] {
+        for (size_t repeat = 0; repeat < REPEAT; ++repeat) {
+            for (size_t index = 0; index < exchanges.size(); ++index) {
+                char frame[SolarMax::MAX_FRAME_SIZE];
+                sink += SolarMax::encodeRequest(valuePointers[index], exchanges[index].address, frame);
+                SolarMax::parseReply(exchanges[index].address,
+                                     SolarMax::Slice(exchanges[index].reply.data(), exchanges[index].reply.size()),
+                                     valuePointers[index]);
+            }
+        }
+    });
+    s_clockSink = sink;
+
+    const size_t frames = REPEAT * exchanges.size();
+    std::cout << "  streams " << std::fixed << std::setprecision(3) << streamMs * 1000.0 / frames
+              << " us/frame, in place " << inPlaceMs * 1000.0 / frames << " us/frame, speedup "
+              << std::setprecision(1) << streamMs / inPlaceMs << "x" << std::endl;
+
+    // both need to produce the same frames and values
+    for (size_t index = 0; index < exchanges.size(); ++index) {
+        char frame[SolarMax::MAX_FRAME_SIZE];
+        const size_t size = SolarMax::encodeRequest(valuePointers[index], exchanges[index].address, frame);
+        if (std::string(frame, size) != StreamCodec::buildMessage(exchanges[index].codes, exchanges[index].address))
+            std::cout << "  Error: request frames differ" << std::endl;
+
+        StreamCodec::parseReply(exchanges[index].address, exchanges[index].reply, exchanges[index].codes,
+                                streamValues);
+        for (size_t code = 0; code < streamValues.size(); ++code) {
+            if (exchanges[index].codes[code].compare(0, 2, "DD") == 0) continue;
+            std::ostringstream hex;
+            if (exchanges[index].codes[code].compare(0, 2, "EC") == 0) hex << "7DB0C1A,0,";
+            hex << std::hex << std::uppercase << streamValues[code];
+            const std::string digits = hex.str();
+            SolarMax::Value expected(exchanges[index].codes[code]);
+            expected.parse(SolarMax::Slice(digits.data(), digits.size()));
+            if (valuePointers[index][code]->value() != expected.value())
+                std::cout << "  Error: values of " << exchanges[index].codes[code] << " differ" << std::endl;
+        }
+    }
+}
+
+void runBenchmarks() {
+    benchmarkClocks();
+    benchmarkResampler();
+    benchmarkIntegration();
+    benchmarkParallelIntegration();
+    benchmarkSolarMaxCodec();
+}
@@ -0,0 +1,9 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/**
+ * Run the benchmarks of the signal processing and print the results
+ */
+void runBenchmarks();
+
+#endif  // BENCHMARK_H
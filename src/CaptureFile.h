@@ -0,0 +1,32 @@
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <cstdint>
+
+/**
+ * Layout of the raw sample capture files. A file starts with the header followed by the records in the order the
+ * samples had been read.
+ */
+namespace CaptureFile {
+
+static const char MAGIC[8] = {'E', 'M', 'C', 'A', 'P', 'T', '0', '1'};
+
+struct Header {
+    char m_magic[8];
+    uint32_t m_recordSize;
+    uint32_t m_reserved;
+    // count of valid records
+    uint64_t m_count;
+};
+
+struct Record {
+    uint64_t m_timeUs;
+    uint16_t m_code;
+    uint8_t m_chipID;
+    uint8_t m_channelID;
+    uint32_t m_reserved;
+};
+
+}  // namespace CaptureFile
+
+#endif  // CAPTURE_FILE_H
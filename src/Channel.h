@@ -5,6 +5,8 @@
 #include "Util.h"
 #include "Log.h"
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 #include <memory>
@@ -23,9 +25,15 @@ public:
     }
 
     virtual void set(float value)
+    {
+        set(value, time());
+    }
+
+    // set the value with the wall clock time it was measured at
+    void set(float value, timeValueUs timestamp)
     {
         m_value = value;
-        m_timestamp = time();
+        m_timestamp = timestamp;
     }
 
     const std::string& name() const
@@ -53,19 +61,32 @@ private:
 class ChannelAD : public Channel
 {
 public:
-    ChannelAD(std::string name, uint32_t chipID, uint32_t channelID, float offset, float factor, timeValueUs timeOffsetUs = 0)
+    // 'offset' and 'factor' are relative to the full scale of the AD converter
+    ChannelAD(std::string name, uint32_t chipID, uint32_t channelID, float offset, float factor, int64_t timeOffsetUs = 0,
+              AdcType type = AdcType::MCP3008)
         : Channel(name)
+        , m_startTimeUs(0)
         , m_chipID(chipID)
         , m_channelID(channelID)
+        , m_type(type)
         , m_offset(offset)
         , m_factor(factor)
+        , m_codeOffset(offset * adcMask(type))
+        , m_codeFactor(factor / adcMask(type))
+        , m_fixedShift(14 - adcBits(type))
+        , m_fixedOffset(static_cast<int16_t>(std::lround(m_codeOffset * (1 << m_fixedShift))))
         , m_timeOffsetUs(timeOffsetUs)
     {
     }
 
     Command command()
     {
-        return Command(m_channelID);
+        return Command(m_channelID, m_type);
+    }
+
+    AdcType type() const
+    {
+        return m_type;
     }
 
     uint32_t chipID() const
@@ -78,46 +99,94 @@ public:
         return m_channelID;
     }
 
-    timeValueUs timeOffset() const
+    int64_t timeOffset() const
     {
         return m_timeOffsetUs;
     }
 
-    void setSample(timeValueUs time, float value)
+    // convert an AD conversion result to the value of the channel
+    float scale(uint16_t code) const
+    {
+        return ((float)code + m_codeOffset) * m_codeFactor;
+    }
+
+    // The AD conversion result with the offset removed as fixed point value, the offset may be a fraction of a code.
+    // fixed(code) * fixedFactor() is the value of the channel.
+    int16_t fixed(uint16_t code) const
     {
-        m_values.push_back(TimeValue(time, (value + m_offset) * m_factor));
+        return static_cast<int16_t>((code << m_fixedShift) + m_fixedOffset);
+    }
+
+    float fixedFactor() const
+    {
+        return m_codeFactor / (1 << m_fixedShift);
+    }
+
+    // Reserve space for 'count' samples, so that adding samples does not allocate memory
+    void reserve(size_t count)
+    {
+        m_times.reserve(count);
+        m_codes.reserve(count);
+    }
+
+    // The samples are stored as the AD conversion result with the time relative to the first sample. Samples need
+    // to be added with ascending times.
+    void setSample(timeValueUs time, uint16_t code)
+    {
+        if (m_times.empty())
+            m_startTimeUs = time;
+        m_times.push_back(static_cast<uint32_t>(time - m_startTimeUs));
+        m_codes.push_back(code);
     }
 
     size_t sampleCount() const
     {
-        return m_values.size();
+        return m_times.size();
     }
 
     float value(size_t index) const
     {
-        return m_values[index].m_value;
+        return scale(m_codes[index]);
+    }
+
+    uint16_t code(size_t index) const
+    {
+        return m_codes[index];
     }
 
     timeValueUs sampleTime(size_t index) const
     {
-        return m_values[index].m_time;
+        return m_startTimeUs + m_times[index];
     }
 
     float sampleAtTime(timeValueUs time) const
     {
-        size_t index = 0;
+        size_t cursor = 0;
+        return sampleAtTime(time, cursor);
+    }
+
+    // Same as above but the search starts at 'cursor' which is updated to the found position. When called with
+    // ascending times this avoids searching from the first sample on each call.
+    float sampleAtTime(timeValueUs time, size_t &cursor) const
+    {
+        // times before the first sample are clamped to it
+        const uint32_t offset = (time > m_startTimeUs) ? static_cast<uint32_t>(time - m_startTimeUs) : 0;
+
+        size_t index = cursor;
 
-        while ((index != m_values.size()) && (time > m_values[index].m_time))
+        while ((index != m_times.size()) && (offset > m_times[index]))
             ++index;
 
-        size_t before = std::min((index == 0) ? 0 : index - 1, m_values.size() - 1);
-        size_t after = std::min(before + 1, m_values.size() - 1);
+        cursor = index;
 
-        float value = m_values[before].m_value;
-        if ((time > m_values[before].m_time) && (m_values[after].m_time != m_values[before].m_time))
+        size_t before = std::min((index == 0) ? 0 : index - 1, m_times.size() - 1);
+        size_t after = std::min(before + 1, m_times.size() - 1);
+
+        float value = scale(m_codes[before]);
+        if ((offset > m_times[before]) && (m_times[after] != m_times[before]))
         {
-            const float factor = (time - m_values[before].m_time) / (m_values[after].m_time - m_values[before].m_time);
-            value += (m_values[after].m_value - m_values[before].m_value) * factor;
+            const float factor = (float)(offset - m_times[before]) / (float)(m_times[after] - m_times[before]);
+            value += (scale(m_codes[after]) - value) * factor;
         }
 
         return value;
@@ -125,27 +194,87 @@ public:
 
     void clearSamples()
     {
-        m_values.clear();
+        m_times.clear();
+        m_codes.clear();
     }
 
 private:
-    struct TimeValue
-    {
-        TimeValue(timeValueUs time, float value)
-            : m_time(time)
-            , m_value(value)
-        {
-        }
-        timeValueUs m_time;
-        float m_value;
-    };
-    std::vector<TimeValue> m_values;
+    // time of the first sample, the sample times are stored relative to it
+    timeValueUs m_startTimeUs;
+    std::vector<uint32_t> m_times;
+    std::vector<uint16_t> m_codes;
 
     uint32_t m_chipID;
     uint32_t m_channelID;
+    AdcType m_type;
     float m_offset;
     float m_factor;
-    timeValueUs m_timeOffsetUs;
+    // offset and factor applied to the AD conversion result
+    float m_codeOffset;
+    float m_codeFactor;
+    // Fractional bits of the fixed point values, the results of all converters are scaled to 14 bits. With offsets
+    // within -1 .. 1 the values fit into 16 bits and the product of two values into 32 bits.
+    int m_fixedShift;
+    int16_t m_fixedOffset;
+    int64_t m_timeOffsetUs;
+};
+
+// Samples of a channel read at the sample times of another channel. Used to show the voltage for a current
+// channel without copying the voltage samples.
+class ChannelADView
+{
+public:
+    // 'source' is read at the sample times of 'timeBase' plus 'timeShiftUs'
+    ChannelADView(std::string name, const ChannelAD *source, const ChannelAD *timeBase, int64_t timeShiftUs)
+        : m_name(name)
+        , m_source(source)
+        , m_timeBase(timeBase)
+        , m_timeShiftUs(timeShiftUs)
+    {
+    }
+
+    // the same view on other channels
+    ChannelADView(const ChannelADView &view, const ChannelAD *source, const ChannelAD *timeBase)
+        : ChannelADView(view.m_name, source, timeBase, view.m_timeShiftUs)
+    {
+    }
+
+    const std::string& name() const
+    {
+        return m_name;
+    }
+
+    const ChannelAD *source() const
+    {
+        return m_source;
+    }
+
+    const ChannelAD *timeBase() const
+    {
+        return m_timeBase;
+    }
+
+    size_t sampleCount() const
+    {
+        return m_source->sampleCount() ? m_timeBase->sampleCount() : 0;
+    }
+
+    timeValueUs sampleTime(size_t index) const
+    {
+        return m_timeBase->sampleTime(index);
+    }
+
+    // 'cursor' is passed to ChannelAD::sampleAtTime(), read with ascending indices
+    float value(size_t index, size_t &cursor) const
+    {
+        return m_source->sampleAtTime(m_timeBase->sampleTime(index) + m_timeShiftUs, cursor);
+    }
+
+private:
+    std::string m_name;
+    const ChannelAD *m_source;
+    const ChannelAD *m_timeBase;
+    int64_t m_timeShiftUs;
 };
 
 class ChannelSum : public Channel
@@ -161,12 +290,19 @@ public:
         m_channels.push_back(channel);
     }
 
-    void update()
+    // the sum is stamped with the time of its newest source value, sources set before 'since' are left out
+    void update(timeValueUs since = 0)
     {
         float value = 0.f;
+        timeValueUs timestamp = 0;
         for (auto &&channel : m_channels)
+        {
+            if (channel->timestamp() < since)
+                continue;
             value += channel->value();
-        set(value);
+            timestamp = std::max(timestamp, channel->timestamp());
+        }
+        set(value, (timestamp != 0) ? timestamp : time());
     }
 
 private:
@@ -2,31 +2,103 @@
 #define COMMAND_H
 
 #include <memory.h>
+#include <stdint.h>
+
+#include <stdexcept>
+#include <string>
+
+// supported AD converters, both are read with 3 byte transfers
+enum class AdcType
+{
+    MCP3008,
+    MCP3208
+};
+
+/**
+ * Command encoding and result decoding of an AD converter type
+ */
+template<AdcType TYPE>
+struct AdcTraits;
+
+// 10 bit, the reply ends with the result
+template<>
+struct AdcTraits<AdcType::MCP3008>
+{
+    static const uint32_t BITS = 10;
+    static const uint32_t MASK = (1 << BITS) - 1;
+
+    // start bit in the first byte, single ended mode and channel in the upper half of the second byte
+    static void encode(uint32_t channel, unsigned char data[3])
+    {
+        data[0] = 0x01;
+        data[1] = (0x08 | channel) << 4;
+        data[2] = 0x00;
+    }
+
+    static uint16_t decode(const unsigned char data[3])
+    {
+        return ((data[1] << 8) | data[2]) & MASK;
+    }
+};
+
+// 12 bit, the command starts two bits later so that the reply ends with the result
+template<>
+struct AdcTraits<AdcType::MCP3208>
+{
+    static const uint32_t BITS = 12;
+    static const uint32_t MASK = (1 << BITS) - 1;
+
+    // start bit, single ended mode and the upper channel bit in the first byte, the other channel bits follow
+    static void encode(uint32_t channel, unsigned char data[3])
+    {
+        data[0] = 0x06 | (channel >> 2);
+        data[1] = (channel & 0x03) << 6;
+        data[2] = 0x00;
+    }
+
+    static uint16_t decode(const unsigned char data[3])
+    {
+        return ((data[1] << 8) | data[2]) & MASK;
+    }
+};
+
+// for the places which are not time critical
+inline uint32_t adcBits(AdcType type)
+{
+    return (type == AdcType::MCP3208) ? AdcTraits<AdcType::MCP3208>::BITS : AdcTraits<AdcType::MCP3008>::BITS;
+}
+
+inline uint32_t adcMask(AdcType type)
+{
+    return (1 << adcBits(type)) - 1;
+}
+
+// the type from its name in the settings
+inline AdcType adcType(const std::string &name)
+{
+    if (name == "MCP3008")
+        return AdcType::MCP3008;
+    if (name == "MCP3208")
+        return AdcType::MCP3208;
+    throw std::runtime_error("Unsupported AD converter " + name);
+}
 
 class Command
 {
 public:
-    Command(unsigned int channel)
+    Command(unsigned int channel, AdcType type = AdcType::MCP3008)
+        : m_type(type)
+        , m_channel(channel)
     {
-        memset(m_sequence.m_data, 0, sizeof(m_sequence.m_data));
-        m_sequence.m_bitfield.m_start = 1;
-        m_sequence.m_bitfield.m_single = 1;
-        m_sequence.m_bitfield.m_channel = channel;
+        if (type == AdcType::MCP3208)
+            AdcTraits<AdcType::MCP3208>::encode(channel, m_data);
+        else
+            AdcTraits<AdcType::MCP3008>::encode(channel, m_data);
     }
 
-    union
-    {
-        struct
-        {
-            unsigned char m_start : 1;
-            unsigned char m_zeroes : 7;
-
-            unsigned char m_ignored : 4;
-            unsigned char m_channel : 3;
-            unsigned char m_single : 1;
-        } m_bitfield;
-        unsigned char m_data[3];
-    } m_sequence;
+    AdcType m_type;
+    uint8_t m_channel;
+    unsigned char m_data[3];
 };
 
 #endif // COMMAND_H
@@ -0,0 +1,166 @@
+#include "EnergyCounter.h"
+
+#include "Log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+static const char MAGIC[8] = {'E', 'M', 'E', 'N', 'R', 'G', '0', '1'};
+
+// CRC-32 (IEEE 802.3)
+static uint32_t crc32(uint32_t crc, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t index = 0; index < size; ++index) {
+        crc ^= bytes[index];
+        for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+uint32_t EnergyCounter::crc(const Copy *copy, size_t count) {
+    return crc32(crc32(0, &copy->m_sequence, sizeof(copy->m_sequence)), copy + 1, count * sizeof(Entry));
+}
+
+EnergyCounter::EnergyCounter(const std::string &fileName, const std::vector<std::string> &names)
+    : m_fileName(fileName),
+      m_names(names),
+      m_wh(names.size(), 0.0),
+      m_fd(-1),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_sequence(0),
+      m_newest(0) {
+    for (auto &&name : m_names) {
+        if (name.size() >= NAME_SIZE) throw std::runtime_error("Channel name too long for energy counter: " + name);
+    }
+
+    if (!restore()) create();
+    for (size_t index = 0; index < m_names.size(); ++index)
+        Log(INFO) << "Energy counter " << m_names[index] << " " << m_wh[index] << " Wh";
+
+    m_fd = ::open(m_fileName.c_str(), O_RDWR);
+    if (m_fd == -1) throw std::runtime_error("Failed to open " + m_fileName);
+    m_mapSize = sizeof(Header) + 2 * copySize(m_names.size());
+    m_map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        throw std::runtime_error("Failed to map " + m_fileName);
+    }
+}
+
+EnergyCounter::~EnergyCounter() {
+    if (m_map) {
+        save();
+        munmap(m_map, m_mapSize);
+    }
+    if (m_fd != -1) ::close(m_fd);
+}
+
+bool EnergyCounter::restore() {
+    const int fd = ::open(m_fileName.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat status;
+    if ((fstat(fd, &status) != 0) || ((size_t)status.st_size < sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) throw std::runtime_error("Failed to map " + m_fileName);
+
+    bool sameChannels = false;
+    const Header *header = static_cast<const Header *>(map);
+    const size_t count = header->m_count;
+    if ((memcmp(header->m_magic, MAGIC, sizeof(MAGIC)) == 0) &&
+        ((size_t)status.st_size >= sizeof(Header) + 2 * copySize(count))) {
+        // the newest valid copy
+        const Copy *newest = nullptr;
+        for (size_t index = 0; index < 2; ++index) {
+            const Copy *candidate =
+                reinterpret_cast<const Copy *>(reinterpret_cast<const char *>(header + 1) + index * copySize(count));
+            if ((crc(candidate, count) == candidate->m_crc) &&
+                (!newest || (candidate->m_sequence > newest->m_sequence))) {
+                newest = candidate;
+                m_newest = index;
+            }
+        }
+
+        if (newest) {
+            std::map<std::string, double> restored;
+            const Entry *entry = reinterpret_cast<const Entry *>(newest + 1);
+            sameChannels = (count == m_names.size());
+            for (size_t index = 0; index < count; ++index, ++entry) {
+                const std::string name(entry->m_name, strnlen(entry->m_name, NAME_SIZE));
+                restored[name] = entry->m_wh;
+                if (sameChannels && (name != m_names[index])) sameChannels = false;
+            }
+            for (size_t index = 0; index < m_names.size(); ++index) {
+                auto it = restored.find(m_names[index]);
+                if (it != restored.end()) m_wh[index] = it->second;
+            }
+            m_sequence = newest->m_sequence;
+        } else {
+            Log(ERROR) << "No valid energy counters in " << m_fileName;
+        }
+    } else {
+        Log(ERROR) << "Invalid energy counter file " << m_fileName;
+    }
+
+    munmap(map, status.st_size);
+    return sameChannels;
+}
+
+void EnergyCounter::create() {
+    // both copies start with the same values
+    std::vector<char> data(sizeof(Header) + 2 * copySize(m_names.size()), 0);
+    Header *header = reinterpret_cast<Header *>(data.data());
+    memcpy(header->m_magic, MAGIC, sizeof(MAGIC));
+    header->m_count = m_names.size();
+    for (size_t index = 0; index < 2; ++index) {
+        Copy *fileCopy = reinterpret_cast<Copy *>(data.data() + sizeof(Header) + index * copySize(m_names.size()));
+        Entry *entry = reinterpret_cast<Entry *>(fileCopy + 1);
+        for (size_t channel = 0; channel < m_names.size(); ++channel) {
+            strncpy(entry[channel].m_name, m_names[channel].c_str(), NAME_SIZE);
+            entry[channel].m_wh = m_wh[channel];
+        }
+        fileCopy->m_sequence = m_sequence + index;
+        fileCopy->m_crc = crc(fileCopy, m_names.size());
+    }
+    m_sequence += 1;
+    m_newest = 1;
+
+    const std::string tempFileName = m_fileName + ".new";
+    const int fd = ::open(tempFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) throw std::runtime_error("Failed to open " + tempFileName);
+    const bool written = (write(fd, data.data(), data.size()) == (ssize_t)data.size()) && (fsync(fd) == 0);
+    ::close(fd);
+    if (!written || (rename(tempFileName.c_str(), m_fileName.c_str()) != 0))
+        throw std::runtime_error("Failed to write " + m_fileName);
+}
+
+EnergyCounter::Copy *EnergyCounter::copy(size_t index) const {
+    return reinterpret_cast<Copy *>(static_cast<char *>(m_map) + sizeof(Header) + index * copySize(m_names.size()));
+}
+
+void EnergyCounter::save() {
+    // overwrite the older copy
+    m_newest ^= 1;
+    ++m_sequence;
+    Copy *fileCopy = copy(m_newest);
+
+    Entry *entry = reinterpret_cast<Entry *>(fileCopy + 1);
+    for (size_t index = 0; index < m_names.size(); ++index) entry[index].m_wh = m_wh[index];
+    fileCopy->m_sequence = m_sequence;
+    fileCopy->m_crc = crc(fileCopy, m_names.size());
+
+    if (msync(m_map, m_mapSize, MS_SYNC) != 0) Log(ERROR) << "Failed to write " << m_fileName;
+}
@@ -0,0 +1,75 @@
+#ifndef ENERGY_COUNTER_H
+#define ENERGY_COUNTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Cumulative energy of each channel, kept in a memory mapped file. The file holds two copies of the counters, save()
+ * overwrites the older one. Each copy has a sequence number and a checksum, if saving is interrupted the other copy
+ * is still valid.
+ */
+class EnergyCounter {
+   public:
+    /**
+     * Open or create 'fileName', counters stored for 'names' are restored, new channels start at zero
+     */
+    EnergyCounter(const std::string &fileName, const std::vector<std::string> &names);
+    ~EnergyCounter();
+
+    // add 'energyWs' (watt seconds) to counter 'index'
+    void add(size_t index, double energyWs) { m_wh[index] += energyWs / 3600.0; }
+
+    // counter 'index' in Wh
+    double wh(size_t index) const { return m_wh[index]; }
+
+    // write the counters to the file
+    void save();
+
+   private:
+    static const size_t NAME_SIZE = 56;
+
+    struct Header {
+        char m_magic[8];
+        uint32_t m_count;
+        uint32_t m_reserved;
+    };
+    struct Entry {
+        char m_name[NAME_SIZE];
+        double m_wh;
+    };
+    struct Copy {
+        uint64_t m_sequence;
+        uint32_t m_crc;
+        uint32_t m_reserved;
+        // followed by m_count entries
+    };
+
+    std::string m_fileName;
+    std::vector<std::string> m_names;
+    std::vector<double> m_wh;
+
+    int m_fd;
+    void *m_map;
+    size_t m_mapSize;
+    uint64_t m_sequence;
+    // index of the copy written last
+    size_t m_newest;
+
+    static size_t copySize(size_t count) { return sizeof(Copy) + count * sizeof(Entry); }
+    static uint32_t crc(const Copy *copy, size_t count);
+
+    /**
+     * Read the counters from the file
+     *
+     * @returns true if the file has the same channels as 'm_names'
+     */
+    bool restore();
+    // write a new file with the channels of 'm_names', the old file is replaced when the new one is complete
+    void create();
+
+    Copy *copy(size_t index) const;
+};
+
+#endif  // ENERGY_COUNTER_H
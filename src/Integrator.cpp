@@ -0,0 +1,194 @@
+#include "Integrator.h"
+
+#include "Log.h"
+#include "PowerKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+VoltageDelayLine::VoltageDelayLine(size_t capacity) : m_samples(capacity), m_count(0) {}
+
+void VoltageDelayLine::clear() { m_count = 0; }
+
+void VoltageDelayLine::push(timeValueUs time, int16_t value) {
+    TimeValue &sample = m_samples[m_count % m_samples.size()];
+    sample.m_time = time;
+    sample.m_value = value;
+    ++m_count;
+}
+
+bool VoltageDelayLine::sampleAtTime(timeValueUs time, uint64_t &cursor, int16_t &value) const {
+    const uint64_t oldest = (m_count > m_samples.size()) ? m_count - m_samples.size() : 0;
+    if (cursor < oldest) cursor = oldest;
+
+    while ((cursor != m_count) && (time > sample(cursor).m_time)) ++cursor;
+
+    // not read yet
+    if (cursor == m_count) return false;
+
+    const TimeValue &after = sample(cursor);
+    if (time == after.m_time) {
+        value = after.m_value;
+        return true;
+    }
+    // already overwritten
+    if (cursor == oldest) return false;
+
+    const TimeValue &before = sample(cursor - 1);
+    value = before.m_value + ((int64_t)(after.m_value - before.m_value) * (int64_t)(time - before.m_time)) /
+                                 (int64_t)(after.m_time - before.m_time);
+    return true;
+}
+
+ZeroCrossingDetector::ZeroCrossingDetector(int32_t hysteresis) : m_hysteresis(hysteresis) { clear(); }
+
+void ZeroCrossingDetector::clear() {
+    m_armed = false;
+    m_prevValid = false;
+    m_prevTimeUs = 0;
+    m_prevValue = 0;
+    m_crossingTimeUs = 0;
+}
+
+bool ZeroCrossingDetector::add(timeValueUs time, int32_t value) {
+    bool crossed = false;
+
+    if (value < -m_hysteresis) {
+        m_armed = true;
+    } else if (m_armed && m_prevValid && (m_prevValue < 0) && (value >= 0)) {
+        m_crossingTimeUs = m_prevTimeUs + ((int64_t)-m_prevValue * (int64_t)(time - m_prevTimeUs)) /
+                                              (int64_t)(value - m_prevValue);
+        m_armed = false;
+        crossed = true;
+    }
+
+    m_prevValid = true;
+    m_prevTimeUs = time;
+    m_prevValue = value;
+
+    return crossed;
+}
+
+PowerIntegrator::PowerIntegrator(int64_t voltageDelayUs, float voltageFactor, float currentFactor)
+    : m_voltageDelayUs(voltageDelayUs), m_voltageFactor(voltageFactor), m_currentFactor(currentFactor) {
+    start(0);
+}
+
+void PowerIntegrator::start(uint32_t periods) {
+    m_markCount = 0;
+    m_periodsToRead = periods;
+    m_periods = 0;
+    m_started = false;
+    m_voltageCursor = 0;
+    m_prevValid = false;
+    m_prevTimeUs = 0;
+    m_prevCurrent = 0;
+    m_prevVoltage = 0;
+    m_sums = Sums();
+    m_result = Sums();
+    m_blockCount = 0;
+}
+
+void PowerIntegrator::next(uint32_t periods) {
+    m_periodsToRead = periods;
+    m_periods = 0;
+    m_result = Sums();
+}
+
+void PowerIntegrator::restart() {
+    if (m_markCount != 0) advance(m_marks[m_markCount - 1]);
+
+    const uint32_t periods = m_periods;
+    const Sums result = m_result;
+    start(m_periodsToRead);
+    m_periods = periods;
+    m_result = result;
+}
+
+void PowerIntegrator::markPeriod(timeValueUs time) {
+    if (m_markCount == MAX_MARKS) {
+        Log(ERROR) << "Too many periods marked without current samples";
+        return;
+    }
+    m_marks[m_markCount++] = time;
+}
+
+void PowerIntegrator::accumulate(timeValueUs deltaTimeUs) {
+    m_blockVoltage[m_blockCount] = m_prevVoltage;
+    m_blockCurrent[m_blockCount] = m_prevCurrent;
+    m_blockTime[m_blockCount] = deltaTimeUs;
+    if (++m_blockCount == BLOCK_SIZE) flush();
+    m_sums.m_timeUs += deltaTimeUs;
+}
+
+void PowerIntegrator::flush() {
+    if (m_blockCount == 0) return;
+
+    int64_t sums[3] = {m_sums.m_p, m_sums.m_u2, m_sums.m_i2};
+    PowerKernel::integrate(m_blockVoltage, m_blockCurrent, m_blockTime, m_blockCount, sums);
+    m_sums.m_p = sums[0];
+    m_sums.m_u2 = sums[1];
+    m_sums.m_i2 = sums[2];
+    m_blockCount = 0;
+}
+
+void PowerIntegrator::advance(timeValueUs time) {
+    timeValueUs fromTimeUs = m_prevTimeUs;
+    while ((m_markCount != 0) && (m_marks[0] <= time)) {
+        const timeValueUs markTimeUs = std::max(m_marks[0], fromTimeUs);
+        for (size_t index = 1; index < m_markCount; ++index) m_marks[index - 1] = m_marks[index];
+        --m_markCount;
+
+        if (m_prevValid && m_started) accumulate(markTimeUs - fromTimeUs);
+        fromTimeUs = markTimeUs;
+
+        if (!m_started) {
+            // after a restart the sums continue from the periods kept
+            m_started = true;
+            m_sums = done() ? Sums() : m_result;
+        } else if (!done()) {
+            ++m_periods;
+            flush();
+            m_result = m_sums;
+            if (done()) m_sums = Sums();
+        }
+    }
+    if (m_prevValid && m_started) accumulate(time - fromTimeUs);
+}
+
+bool PowerIntegrator::add(timeValueUs time, int16_t current, const VoltageDelayLine &voltage) {
+    // The interval from the previous sample to this one is added to the sums. If a period starts within the
+    // interval, it is split at the period start.
+    advance(time);
+
+    m_prevValid = voltage.sampleAtTime(time + m_voltageDelayUs, m_voltageCursor, m_prevVoltage);
+    m_prevTimeUs = time;
+    m_prevCurrent = current;
+
+    return m_prevValid;
+}
+
+float PowerIntegrator::power() const {
+    if (m_result.m_timeUs == 0) return 0.f;
+    return (double)m_result.m_p * m_voltageFactor * m_currentFactor / (double)m_result.m_timeUs;
+}
+
+double PowerIntegrator::energy() const {
+    return (double)m_result.m_p * m_voltageFactor * m_currentFactor / 1000000.0;
+}
+
+float PowerIntegrator::voltageRms() const {
+    if (m_result.m_timeUs == 0) return 0.f;
+    return std::sqrt((double)m_result.m_u2 / (double)m_result.m_timeUs) * m_voltageFactor;
+}
+
+float PowerIntegrator::currentRms() const {
+    if (m_result.m_timeUs == 0) return 0.f;
+    return std::sqrt((double)m_result.m_i2 / (double)m_result.m_timeUs) * m_currentFactor;
+}
+
+float PowerIntegrator::powerFactor() const {
+    const float s = apparentPower();
+    if (s == 0.f) return 0.f;
+    return power() / s;
+}
@@ -0,0 +1,184 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "Util.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The DSP works on the AD conversion results with the channel offset removed, see ChannelAD::fixed(). The values
+ * are converted to physical units with the channel factors once per window.
+ */
+
+/**
+ * Ring buffer with the most recent samples of the voltage channel. The current channels read the voltage at their
+ * sample time shifted by the phase offset from it.
+ */
+class VoltageDelayLine {
+   public:
+    explicit VoltageDelayLine(size_t capacity);
+
+    void clear();
+    void push(timeValueUs time, int16_t value);
+
+    /**
+     * Interpolate the voltage at 'time'. 'cursor' is the search position of the reader, it is updated and needs to
+     * be kept between calls with ascending times.
+     *
+     * @returns false if the time is not covered by the buffered samples
+     */
+    bool sampleAtTime(timeValueUs time, uint64_t &cursor, int16_t &value) const;
+
+   private:
+    struct TimeValue {
+        timeValueUs m_time;
+        int16_t m_value;
+    };
+    std::vector<TimeValue> m_samples;
+    // count of samples pushed since the last clear, the samples in the buffer are [m_count - capacity, m_count)
+    uint64_t m_count;
+
+    const TimeValue &sample(uint64_t index) const { return m_samples[index % m_samples.size()]; }
+};
+
+/**
+ * Finds the rising zero crossings of the voltage
+ */
+class ZeroCrossingDetector {
+   public:
+    /**
+     * @param hysteresis the voltage needs to be below -hysteresis before a crossing is detected, this suppresses
+     *                   multiple crossings caused by noise
+     */
+    explicit ZeroCrossingDetector(int32_t hysteresis);
+
+    void clear();
+
+    /**
+     * Add a sample
+     *
+     * @returns true if the voltage crossed zero since the previous sample, crossingTime() returns the time
+     */
+    bool add(timeValueUs time, int32_t value);
+
+    // interpolated time of the last crossing
+    timeValueUs crossingTime() const { return m_crossingTimeUs; }
+
+   private:
+    int32_t m_hysteresis;
+    bool m_armed;
+    bool m_prevValid;
+    timeValueUs m_prevTimeUs;
+    int32_t m_prevValue;
+    timeValueUs m_crossingTimeUs;
+};
+
+/**
+ * Integrates the power and the squared voltage and current of one current channel while the samples arrive. The
+ * integration runs over a whole number of line periods, the start of each period is set with markPeriod().
+ */
+class PowerIntegrator {
+   public:
+    /**
+     * @param voltageDelayUs offset from the current sample time to the time of the voltage to use, needs to be
+     *                       negative so that the voltage had already been read
+     * @param voltageFactor, currentFactor convert the sample values to volt and ampere
+     */
+    PowerIntegrator(int64_t voltageDelayUs, float voltageFactor, float currentFactor);
+
+    int64_t voltageDelay() const { return m_voltageDelayUs; }
+
+    /**
+     * Start a new integration window of 'periods' line periods, the window starts at the next marked period
+     */
+    void start(uint32_t periods);
+
+    /**
+     * Continue with a new window of 'periods' line periods when the current one is done. The new window starts at
+     * the period that completed the current one, the samples since then are kept.
+     */
+    void next(uint32_t periods);
+
+    /**
+     * Start again at the next marked period after samples are missing. The periods completed so far are kept and
+     * the window continues with the remaining ones, the marked periods not yet reached are closed with the last
+     * sample.
+     */
+    void restart();
+
+    /**
+     * Mark the start of a line period (zero crossing of the voltage)
+     */
+    void markPeriod(timeValueUs time);
+
+    /**
+     * Add a current sample, the voltage for it is taken from 'voltage'
+     *
+     * @returns false if the voltage for the sample is not available
+     */
+    bool add(timeValueUs time, int16_t current, const VoltageDelayLine &voltage);
+
+    // count of integrated periods
+    uint32_t periods() const { return m_periods; }
+    bool done() const { return m_periods == m_periodsToRead; }
+
+    // average (real) power over the integrated periods
+    float power() const;
+    float voltageRms() const;
+    float currentRms() const;
+    float apparentPower() const { return voltageRms() * currentRms(); }
+    float powerFactor() const;
+    // energy (watt seconds) over the integrated periods
+    double energy() const;
+
+   private:
+    // the sums are exact, the factors are applied when reading the results
+    struct Sums {
+        int64_t m_p;
+        int64_t m_u2;
+        int64_t m_i2;
+        timeValueUs m_timeUs;
+    };
+
+    void accumulate(timeValueUs deltaTimeUs);
+    // integrate up to 'time' with the previous sample, handling the marked periods up to then
+    void advance(timeValueUs time);
+    // add the block of pending intervals to the sums
+    void flush();
+
+    int64_t m_voltageDelayUs;
+    float m_voltageFactor;
+    float m_currentFactor;
+
+    // the marked periods not yet reached by the current samples
+    static const size_t MAX_MARKS = 4;
+    timeValueUs m_marks[MAX_MARKS];
+    size_t m_markCount;
+
+    uint32_t m_periodsToRead;
+    uint32_t m_periods;
+    bool m_started;
+
+    uint64_t m_voltageCursor;
+    bool m_prevValid;
+    timeValueUs m_prevTimeUs;
+    int16_t m_prevCurrent;
+    int16_t m_prevVoltage;
+
+    // running sums and the sums at the end of the last complete period, after the window is done the running sums
+    // collect the start of the next window
+    Sums m_sums;
+    Sums m_result;
+
+    // Intervals not yet added to the running sums, they are added in blocks by the PowerKernel. The sums are
+    // complete after flush().
+    static const size_t BLOCK_SIZE = 64;
+    int16_t m_blockVoltage[BLOCK_SIZE];
+    int16_t m_blockCurrent[BLOCK_SIZE];
+    int32_t m_blockTime[BLOCK_SIZE];
+    size_t m_blockCount;
+};
+
+#endif  // INTEGRATOR_H
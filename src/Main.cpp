@@ -1,3 +1,4 @@
+#include "Benchmark.h"
 #include "SignalHandler.h"
 #include "Solar.h"
 #include "Power.h"
@@ -16,6 +17,12 @@ int main(int argc, char * const *argv)
     {
         Options::getInstance().parseCmdLine(argc, argv);
 
+        if (Options::getInstance().benchmark())
+        {
+            runBenchmarks();
+            return 0;
+        }
+
         // run solar tracking in the background
         solar.reset(new Solar);
         solar->start();
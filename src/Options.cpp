@@ -46,6 +46,7 @@ void Options::initialize()
 {
     m_logLevel = ERROR;
     m_updatePeriod = std::chrono::seconds(1 * 60);
+    m_benchmark = false;
 }
 
 void Options::parseCmdLine(int argc, char * const *argv)
@@ -55,6 +56,7 @@ void Options::parseCmdLine(int argc, char * const *argv)
         OPTION_HELP,
         OPTION_LOG_LEVEL,
         OPTION_UPDATE_PERIOD,
+        OPTION_BENCHMARK,
     };
 
     static struct option options[] =
@@ -62,6 +64,7 @@ void Options::parseCmdLine(int argc, char * const *argv)
         { "help",           no_argument,       0, 'h' },
         { "loglevel",       required_argument, 0, 'l' },
         { "updateperiod",   required_argument, 0, OPTION_UPDATE_PERIOD },
+        { "benchmark",      no_argument,       0, OPTION_BENCHMARK },
         { 0,                0,                 0,  0  }
     };
 
@@ -83,7 +86,9 @@ void Options::parseCmdLine(int argc, char * const *argv)
                 "  -l, --loglevel=LEVEL\n"
                 "    Set the log level to LEVEL. LEVEL can be '" << DEBUG << "', '" << INFO << "', '" << WARN << "' or '" << ERROR << "'. Default " << m_logLevel << ".\n"
                 "  --updateperiod=PERIOD\n" <<
-                "    Sets the update period to PERIOD seconds. Default " << m_updatePeriod.count() << ".\n";
+                "    Sets the update period to PERIOD seconds, 0 starts the next update right away. Default " << m_updatePeriod.count() << ".\n"
+                "  --benchmark\n"
+                "    Run the benchmarks and exit.\n";
             exit(EXIT_SUCCESS);
         case 'l':
             if (std::string(optarg) == "DEBUG")
@@ -110,10 +115,13 @@ void Options::parseCmdLine(int argc, char * const *argv)
             break;
         case OPTION_UPDATE_PERIOD:
             valInt = atoi(optarg);
-            if (valInt <= 0)
+            if (valInt < 0)
                 throw std::runtime_error("Invalid update period value");
             m_updatePeriod = std::chrono::seconds(valInt);
             break;
+        case OPTION_BENCHMARK:
+            m_benchmark = true;
+            break;
         default:
             throw std::runtime_error("Unhandled option");
         }
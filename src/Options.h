@@ -31,6 +31,11 @@ public:
         return m_updatePeriod;
     }
 
+    bool benchmark() const
+    {
+        return m_benchmark;
+    }
+
 private:
     // this is a singleton, hide copy constructor etc.
     Options(const Options&);
@@ -43,6 +48,7 @@ private:
 
     LogLevel m_logLevel;
     std::chrono::seconds m_updatePeriod;
+    bool m_benchmark;
 };
 
 #endif // OPTIONS_H
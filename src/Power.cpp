@@ -1,95 +1,98 @@
 #include "Power.h"
 
+#include "Options.h"
 #include "Post.h"
+#include "PowerKernel.h"
 #include "Server.h"
 #include "Settings.h"
 
-#ifdef BCM2835
-#include <bcm2835/bcm2835.h>
-#elif defined(WIRINGPI)
-#include <wiringPi.h>
-#include <wiringPiSPI.h>
-#endif
-
-#include <sched.h>
-#include <unistd.h>
-
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <thread>
 #include <vector>
 
-static const uint32_t ADC_BITS = 10;
-static const uint32_t ADC_MASK = (1 << ADC_BITS) - 1;
-// zero point (ADC input connected to 'adcOffsetVoltage')
-static const float ADC_OFFSET = (511.0f / ADC_MASK);
 static const float LINE_VOLTAGE = 230.0f;
 static const float LINE_VOLTAGE_PEAK = LINE_VOLTAGE * std::sqrt(2.f);
 static const float LINE_FREQUENCY = 50.0f;
 static const timeValueUs LINE_PERIOD_TIME_US = 1000000 / LINE_FREQUENCY;
-// transfomer ratio between primary and secondary
-static const float TRANSFORMER_RATIO = (230.0f / 12.50f);  // measured
 // ratio between input to transfomer and input to AD
 static const float TRANSFORMER_LINE_VOLTAGE_RATIO = (228.0f / 0.962f);  // measured
-static const double PI = std::acos(-1.f);
 
 // calibration
-static const float CAL_OFFSET_VOLTAGE = (-2.0f / ADC_MASK);  // measured
+static const float CAL_OFFSET_VOLTAGE_CODES = -2.0f;  // measured with a MCP3008
 static const float CAL_FACTOR_VOLTAGE = 1.0f;
 // CT sensor phase correction (7 degree)
 // (see
 // https://learn.openenergymonitor.org/electricity-monitoring/ct-sensors/yhdc-ct-sensor-report)
 static const timeValueUs CAL_PHASE_CORRECTION = (LINE_PERIOD_TIME_US * 7) / 360;
 
-// how many periods to read when calculating the power
-static const uint32_t PERIODS_TO_READ = 20;
-
-#ifndef RPI
-#ifdef BCM2835
-int bcm2835_init(void) { return 1; }
-int bcm2835_close(void) { return 1; }
-int bcm2835_spi_begin() { return 1; }
-void bcm2835_spi_end() {}
-void bcm2835_spi_setBitOrder(uint8_t order) {}
-void bcm2835_spi_setDataMode(uint8_t mode) {}
-void bcm2835_spi_setClockDivider(uint16_t divider) {}
-void bcm2835_spi_setChipSelectPolarity(uint8_t cs, uint8_t active) {}
-void bcm2835_spi_chipSelect(uint8_t cs) {}
-void bcm2835_spi_transfernb(char *tbuf, char *rbuf, uint32_t len) {}
-#endif
-#endif
-
-/**
- * RAII type class to set the thread priority to real time
- */
-class Scheduler {
-   public:
-    Scheduler() : m_policy(sched_getscheduler(m_pid)) {
-        sched_getparam(m_pid, &m_param);
-
-        auto param = m_param;
-        param.sched_priority = sched_get_priority_max(SCHED_FIFO);
-        sched_setscheduler(m_pid, SCHED_FIFO, &param);
-    }
+// default of how many periods to read when calculating the power
+static const uint32_t PERIODS_TO_READ = 5;
+// the voltage needs to be below this before a zero crossing is detected
+static const float ZERO_CROSSING_HYSTERESIS = LINE_VOLTAGE_PEAK * 0.1f;
+// count of voltage samples buffered for the phase correction, needs to cover two periods
+static const size_t VOLTAGE_DELAY_LINE_SIZE = 4096;
+// if there is more time than this between two scans the window is restarted
+static const timeValueUs MAX_SCAN_GAP_US = LINE_PERIOD_TIME_US;
+// one conversion of the MCP3008 takes 24 SPI clocks, 1 MHz is the highest clock at 2.7 V
+static const timeValueUs MIN_CONVERSION_TIME_US = 24;
+// time to wait for the acquisition if there is no sample block
+static const std::chrono::microseconds BLOCK_WAIT_TIME(500);
+// most scans processed as one batch, together with two periods they need to fit into the voltage delay line
+static const size_t MAX_BATCH = 256;
+// default file of the energy counters in continuous mode
+static const std::string ENERGY_FILE("energy.bin");
+
+// the AD converter of a chip, set with 'type' of the entry for the chip in 'chips' in the 'hardware' settings
+static AdcType chipType(const nlohmann::json &hardware, uint32_t chipID) {
+    const nlohmann::json chips = hardware.value("chips", nlohmann::json::array());
+    if (chipID >= chips.size()) return AdcType::MCP3008;
+    return adcType(chips[chipID].value("type", "MCP3008"));
+}
 
-    ~Scheduler() { sched_setscheduler(m_pid, m_policy, &m_param); }
+// zero point (ADC input connected to 'adcOffsetVoltage'), the middle code of the range of the chip
+static float adcOffset(AdcType type) {
+    const uint32_t mask = adcMask(type);
+    return float(mask >> 1) / mask;
+}
 
-   private:
-    static const pid_t m_pid = 0;
-    int m_policy;
-    struct sched_param m_param;
-};
+// the calibration of the voltage channel scaled from the codes of the MCP3008 to the resolution of the chip
+static float calOffsetVoltage(AdcType type) {
+    const uint32_t mask = adcMask(type);
+    return CAL_OFFSET_VOLTAGE_CODES * (mask + 1) / (AdcTraits<AdcType::MCP3008>::MASK + 1) / mask;
+}
 
-Power::Power() : BackgroundTask(true) {
+Power::Power()
+    : BackgroundTask(true),
+      m_frequency("frequency"),
+      m_voltageDelayLine(VOLTAGE_DELAY_LINE_SIZE),
+      m_zeroCrossingDetector(0),
+      m_windowContinues(false),
+      m_nextSequence(0),
+      m_prevScanEndUs(0),
+      m_lastZeroCrossingUs(0) {
     auto &settings = Settings::getInstance();
 
+    auto hardware = settings.get("hardware");
+    std::unique_ptr<AdcDriver> adc;
     {
-        auto hardware = settings.get("hardware");
         m_refVoltage = hardware.at("refVoltage");
         Log(INFO) << "refVoltage " << m_refVoltage;
         m_adcOffsetVoltage = hardware.at("adcOffsetVoltage");
         Log(INFO) << "adcOffsetVoltage " << m_adcOffsetVoltage;
+        m_periodsToRead = hardware.value("periods", PERIODS_TO_READ);
+        if (m_periodsToRead == 0) throw std::runtime_error("At least one period needs to be read");
+        Log(INFO) << "periods " << m_periodsToRead;
+        m_continuous = hardware.value("continuous", false);
+        Log(INFO) << "continuous " << m_continuous;
+        PowerKernel::select(hardware.value("simd", true));
+        Log(INFO) << "power kernel " << PowerKernel::selectedName();
+        adc = AdcDriver::create(hardware);
     }
 
     auto voltageChannel = settings.get("voltageChannel");
@@ -99,8 +102,14 @@ Power::Power() : BackgroundTask(true) {
     const int voltageChannelPhase = voltageChannel.at("phase");
     Log(INFO) << "Adding voltage channel " << voltageChannelName << " at " << voltageChipID << ":" << voltageChannelID
               << " phase " << voltageChannelPhase;
-    m_voltageChannel.reset(new ChannelAD(voltageChannelName, voltageChipID, voltageChannelID, -1.f * ADC_OFFSET + CAL_OFFSET_VOLTAGE,
-                        m_refVoltage * TRANSFORMER_LINE_VOLTAGE_RATIO * CAL_FACTOR_VOLTAGE));
+    const AdcType voltageChipType = chipType(hardware, voltageChipID);
+    m_voltageChannel.reset(new ChannelAD(voltageChannelName, voltageChipID, voltageChannelID,
+                                         -1.f * adcOffset(voltageChipType) + calOffsetVoltage(voltageChipType),
+                                         m_refVoltage * TRANSFORMER_LINE_VOLTAGE_RATIO * CAL_FACTOR_VOLTAGE, 0,
+                                         voltageChipType));
+    // the DSP works on the fixed point values of the AD conversion results
+    m_zeroCrossingDetector =
+        ZeroCrossingDetector(std::lround(ZERO_CROSSING_HYSTERESIS / m_voltageChannel->fixedFactor()));
 
 
     Log(INFO) << "Adding current channels...";
@@ -117,16 +126,78 @@ Power::Power() : BackgroundTask(true) {
 
         // (U / R) * ratio
         const float calibFactor = (1.f / resistance) * 1860.f;
-        const float calibTimeOffset = (LINE_PERIOD_TIME_US * (voltageChannelPhase - phase)) / 3;
+        const int64_t calibTimeOffset = ((int64_t)LINE_PERIOD_TIME_US * (voltageChannelPhase - phase)) / 3;
+
+        const AdcType type = chipType(hardware, chipID);
+        m_currentChannels.push_back(std::unique_ptr<ChannelAD>(
+            new ChannelAD(channelName, chipID, channelID, -1.f * adcOffset(type) + calibOffset,
+                          m_refVoltage * calibFactor, calibTimeOffset, type)));
+
+        // The voltage for a current sample is taken from the delay line. The line voltage is periodic, therefore the
+        // offset is moved by whole periods into the range of (-2, -1] periods before the current sample.
+        int64_t voltageDelayUs = calibTimeOffset - (int64_t)CAL_PHASE_CORRECTION;
+        while (voltageDelayUs > -(int64_t)LINE_PERIOD_TIME_US) voltageDelayUs -= LINE_PERIOD_TIME_US;
+        while (voltageDelayUs <= -2 * (int64_t)LINE_PERIOD_TIME_US) voltageDelayUs += LINE_PERIOD_TIME_US;
+        m_integrators.push_back(PowerIntegrator(voltageDelayUs, m_voltageChannel->fixedFactor(),
+                                                m_currentChannels.back()->fixedFactor()));
+        m_rmsChannels.emplace_back(channelName);
+
+        // the voltage used for the integration of each current sample
+        m_voltageViews.emplace_back(channelName + "_voltage", m_voltageChannel.get(), m_currentChannels.back().get(),
+                                    voltageDelayUs);
+    }
 
-        m_currentChannels.push_back(
-            std::unique_ptr<ChannelAD>(new ChannelAD(channelName, chipID, channelID, -1.f * ADC_OFFSET + calibOffset,
-                                                     m_refVoltage * calibFactor, calibTimeOffset)));
+    // All current channels and the shared voltage channel are read round-robin in one scan. The scan is grouped by
+    // chip, each chip gets its commands in one transfer. The driver orders the chips.
+    {
+        std::vector<std::vector<Command>> cmds;
+        std::vector<std::vector<ScanChannel>> scanChannels;
+
+        auto addToScan = [&cmds, &scanChannels](const ScanChannel &scanChannel) {
+            const uint32_t chipID = scanChannel.m_channel->chipID();
+            if (chipID >= cmds.size()) {
+                cmds.resize(chipID + 1);
+                scanChannels.resize(chipID + 1);
+            }
+            cmds[chipID].push_back(scanChannel.m_channel->command());
+            scanChannels[chipID].push_back(scanChannel);
+        };
+
+        auto itIntegrator = m_integrators.begin();
+        for (auto &&channel : m_currentChannels) {
+            addToScan({channel.get(), &*itIntegrator});
+            ++itIntegrator;
+        }
+        addToScan({m_voltageChannel.get(), nullptr});
+
+        m_acquisition.reset(new Acquisition(std::move(adc), cmds, hardware));
 
-        // add a voltage channel for each current channel
-        m_voltageChannels.push_back(std::unique_ptr<ChannelAD>(
-            new ChannelAD(channelName + "_voltage", voltageChipID, voltageChannelID, -1.f * ADC_OFFSET + CAL_OFFSET_VOLTAGE,
-                          m_refVoltage * TRANSFORMER_LINE_VOLTAGE_RATIO * CAL_FACTOR_VOLTAGE)));
+        for (auto &&chipID : m_acquisition->chipOrder())
+            m_scanChannels.insert(m_scanChannels.end(), scanChannels[chipID].begin(), scanChannels[chipID].end());
+        for (auto &&integrator : m_integrators) {
+            for (size_t index = 0; index < m_scanChannels.size(); ++index)
+                if (m_scanChannels[index].m_integrator == &integrator) m_currentScanIndexes.push_back(index);
+        }
+        for (size_t index = 0; index < m_scanChannels.size(); ++index)
+            if (!m_scanChannels[index].m_integrator) m_voltageScanIndex = index;
+
+        // Each channel gets one sample per scan. The samples of a window are preallocated for the fastest scan
+        // rate, the window may take up to two periods longer than expected.
+        const timeValueUs windowTimeUs = (m_periodsToRead + 4) * LINE_PERIOD_TIME_US;
+        const size_t scansPerWindow = windowTimeUs / (m_scanChannels.size() * MIN_CONVERSION_TIME_US) + 1;
+        Log(INFO) << "Reserving " << scansPerWindow << " samples per channel";
+        for (auto &&scanChannel : m_scanChannels) scanChannel.m_channel->reserve(scansPerWindow);
+    }
+
+    // one worker for each core not used by the power and the acquisition thread
+    {
+        const int cpuCount = std::thread::hardware_concurrency();
+        const int spareCpus = cpuCount - 1 - ((m_acquisition->cpu() >= 0) ? 1 : 0);
+        const size_t workers = hardware.value("dspThreads", std::max(spareCpus, 0));
+        Log(INFO) << "dspThreads " << workers;
+        m_workers.reset(new WorkerPool(workers));
+        m_batch.reserve(MAX_BATCH);
+        m_missingVoltage.resize(m_integrators.size());
     }
 
     // create the sum channels
@@ -153,284 +224,323 @@ Power::Power() : BackgroundTask(true) {
             c->add(it->get());
         }
     }
-    Log(INFO) << "..done";
-}
 
-Power::~Power() {}
+    if (m_continuous) {
+        const std::string energyFile = settings.get("hardware").value("energyFile", ENERGY_FILE);
+        Log(INFO) << "Adding energy counters in " << energyFile;
 
-static void read(uint32_t chipID, std::vector<Command> &cmds, std::vector<float> &values,
-                 std::vector<timeValueUs> &times) {
-#ifdef RPI
-#ifdef BCM2835
-    static const bcm2835SPIChipSelect cs[] = {BCM2835_SPI_CS0, BCM2835_SPI_CS1};
-
-    // select the chip
-    bcm2835_spi_chipSelect(cs[chipID]);
-#endif  // BCM2835
-
-    const size_t commandSize = sizeof(Command::m_sequence.m_data);
-    unsigned char reply[commandSize];
-
-    for (auto &&cmd : cmds) {
-#ifdef BCM2835
-        bcm2835_spi_transfernb(reinterpret_cast<char *>(cmd.m_sequence.m_data), reinterpret_cast<char *>(reply),
-                               commandSize);
-#elif defined(WIRINGPI)
-        memcpy(reply, cmd.m_sequence.m_data, commandSize);
-        wiringPiSPIDataRW(chipID, reply, commandSize);
-#endif  // BCM2835
-        times.push_back(time());
-
-        uint32_t value = 0;
-        for (size_t i = 0; i < commandSize; ++i) {
-            value <<= 8;
-            value += reply[i];
+        std::vector<std::string> names;
+        for (auto &&channel : m_currentChannels) {
+            names.push_back(channel->name());
+            m_energyChannels.emplace_back(channel->name() + "_kwh");
+        }
+        m_energyCounter.reset(new EnergyCounter(energyFile, names));
+
+        // the sums of the energy have the same sources as the sums of the power
+        for (auto &channel : sumChannels) {
+            const std::string channelName = channel.at("name");
+            m_energySumChannels.push_back(std::unique_ptr<ChannelSum>(new ChannelSum(channelName + "_kwh")));
+            for (auto &source : channel.at("sources")) {
+                const std::string sourceName = source;
+                const auto it = std::find_if(m_energyChannels.begin(), m_energyChannels.end(),
+                                             [&sourceName](const Channel &energyChannel) {
+                                                 return sourceName + "_kwh" == energyChannel.name();
+                                             });
+                m_energySumChannels.back()->add(&*it);
+            }
         }
-
-        // mask out undefined bits
-        value &= ADC_MASK;
-
-        float normalized = (float)value / (float)ADC_MASK;
-        values.push_back(normalized);
-    }
-#else  // RPI
-    static timeValueUs startTime = 0;
-    if (!startTime) startTime = time();
-    const timeValueUs curTime = time() - startTime;
-    const float wave = std::sin(std::fmod((float)curTime / 1000000.f / (1.f / LINE_FREQUENCY), 1.f) * 2.0f * PI);
-    for (auto &&cmd : cmds) {
-        // factor to calculate voltage from input signal
-        static const float factor[2][8] = {
-            {
-                0.9f / CT_AMPERE_PER_VOLT,  // 146.37 W
-                0.5f / CT_AMPERE_PER_VOLT,  // 81.32 W
-                1.6f / CT_AMPERE_PER_VOLT,  // 260.22 W
-                0.8f / CT_AMPERE_PER_VOLT,
-                0.1f / CT_AMPERE_PER_VOLT,
-                0.2f / CT_AMPERE_PER_VOLT,
-                0.3f / CT_AMPERE_PER_VOLT,
-                0.4f / CT_AMPERE_PER_VOLT,
-            },
-            {1.f / CT_AMPERE_PER_VOLT, 2.f / CT_AMPERE_PER_VOLT, 3.f / CT_AMPERE_PER_VOLT, 4.f / CT_AMPERE_PER_VOLT,
-             5.f / CT_AMPERE_PER_VOLT, 6.f / CT_AMPERE_PER_VOLT,
-             7.f / CT_AMPERE_PER_VOLT,  // 1138.44
-             // voltage channel
-             LINE_VOLTAGE_PEAK / ((120.f + 10.f) / 10.f) * TRANSFORMER_RATIO},
-        };
-
-        float value = wave * factor[chipID][cmd.m_sequence.m_bitfield.m_channel];
-        // convert to -.5 ... .5
-        value /= m_refVoltage / 2.f;
-        // and to 0 ... 1
-        value += 0.5f;
-        values.push_back(value);
     }
-#endif
+    Log(INFO) << "..done";
 }
 
-void Power::update(std::unique_ptr<ChannelAD> &channel, std::unique_ptr<ChannelAD> &voltageChannel) {
-    std::vector<std::vector<Command>> cmds;
+Power::~Power() {}
+
+bool Power::update() {
+    SpscRing<SampleBlock> &blocks = m_acquisition->blocks();
 
-    {
-        const uint32_t chipID = channel->chipID();
-        if (chipID >= cmds.size()) cmds.resize(chipID + 1);
-        cmds[chipID].push_back(channel->command());
-        channel->clearSamples();
+    if (!m_continuous) {
+        // the scans queued since the last window are outdated, unless they are replayed or simulated
+        if (m_acquisition->realTime()) {
+            blocks.flush();
+            m_acquisition->takeDropped();
+        }
+        m_windowContinues = false;
+        m_acquisition->resume();
     }
 
-    const uint32_t chipID = m_voltageChannel->chipID();
-    if (chipID >= cmds.size()) cmds.resize(chipID + 1);
-    cmds[chipID].push_back(m_voltageChannel->command());
-    m_voltageChannel->clearSamples();
+    // The first two periods fill the voltage delay line for the phase correction, then the power is integrated
+    // while the samples arrive. The integration starts at the next zero crossing of the voltage and runs over
+    // whole periods. If the periods are not found within two more periods than expected, the window is closed
+    // with the periods found so far. In continuous mode the next window starts where the last one ended.
+    timeValueUs startSampleTimeUs = 0;
+    timeValueUs timeoutUs = 0;
+    uint32_t periodsLeft = m_periodsToRead;
+
+    // zero crossings used to measure the line frequency
+    uint32_t zeroCrossings = 0;
+    timeValueUs firstZeroCrossingUs = 0;
+
+    auto clearWindow = [&]() {
+        for (auto &&scanChannel : m_scanChannels) scanChannel.m_channel->clearSamples();
+        std::fill(m_missingVoltage.begin(), m_missingVoltage.end(), 0);
+    };
+    // After dropped scans or a gap the window starts again, the periods completed before are kept so their energy
+    // is counted and they are part of the averages. The window continues with the remaining periods.
+    auto startWindow = [&](timeValueUs startTimeUs, bool restart) {
+        if (restart) {
+            for (auto &&integrator : m_integrators) integrator.restart();
+            // the integrators got the same period marks, they completed the same count of periods
+            periodsLeft = m_integrators.empty() ? 0 : m_periodsToRead - m_integrators.front().periods();
+        } else {
+            for (auto &&integrator : m_integrators) integrator.start(m_periodsToRead);
+            periodsLeft = m_periodsToRead;
+        }
+        startSampleTimeUs = startTimeUs + 2 * LINE_PERIOD_TIME_US;
+        timeoutUs = startSampleTimeUs + (periodsLeft + 2) * LINE_PERIOD_TIME_US;
 
-    std::vector<std::vector<float>> values(cmds.size());
-    std::vector<std::vector<timeValueUs>> times(cmds.size());
-    std::vector<size_t> indices(cmds.size());
+        m_voltageDelayLine.clear();
+        m_zeroCrossingDetector.clear();
+        clearWindow();
 
-    // switch scheduler to high priority
-    std::unique_ptr<Scheduler> scheduler(new Scheduler());
+        zeroCrossings = 0;
+        firstZeroCrossingUs = 0;
+        m_lastZeroCrossingUs = 0;
+        m_windowContinues = true;
+    };
 
-    // samling intervale (+2 periods for phase correction)
-    const timeValueUs sampleTimeUs = LINE_PERIOD_TIME_US * (PERIODS_TO_READ + 2);
-    auto startTimeUs = time();
-    timeValueUs endTimeUs;
+    if (m_windowContinues) {
+        // the zero crossing which closed the last window opens this one
+        startSampleTimeUs = m_lastZeroCrossingUs;
+        timeoutUs = startSampleTimeUs + (m_periodsToRead + 2) * LINE_PERIOD_TIME_US;
 
-    // read and write to channels
-    do {
-        endTimeUs = time();
+        for (auto &&integrator : m_integrators) integrator.next(m_periodsToRead);
+        clearWindow();
 
-        for (auto &&value : values) value.clear();
-        for (auto &&time : times) time.clear();
+        zeroCrossings = 1;
+        firstZeroCrossingUs = m_lastZeroCrossingUs;
+    }
 
-        uint32_t chipID = 0;
-        for (auto &&chipCmd : cmds) {
-            read(chipID, chipCmd, values[chipID], times[chipID]);
-            ++chipID;
+    // the voltage of a scan, returns true if the voltage crossed zero and a period was marked
+    auto addVoltage = [&](const SampleBlock &block) {
+        ChannelAD *channel = m_scanChannels[m_voltageScanIndex].m_channel;
+        const timeValueUs time = block.m_times[m_voltageScanIndex];
+        const uint16_t code = block.m_codes[m_voltageScanIndex];
+        const int16_t voltage = channel->fixed(code);
+        channel->setSample(time, code);
+        m_voltageDelayLine.push(time, voltage);
+
+        if (!m_zeroCrossingDetector.add(time, voltage) || (m_zeroCrossingDetector.crossingTime() < startSampleTimeUs))
+            return false;
+
+        m_lastZeroCrossingUs = m_zeroCrossingDetector.crossingTime();
+        if (zeroCrossings == 0) firstZeroCrossingUs = m_lastZeroCrossingUs;
+        ++zeroCrossings;
+
+        for (auto &&integrator : m_integrators) integrator.markPeriod(m_lastZeroCrossingUs);
+        return true;
+    };
+
+    // the current samples of one channel in the batch, they take the voltage from the delay line
+    const std::function<void(size_t)> integrateChannel = [&](size_t currentIndex) {
+        const size_t scanIndex = m_currentScanIndexes[currentIndex];
+        const ScanChannel &scanChannel = m_scanChannels[scanIndex];
+        uint32_t missingVoltage = 0;
+        for (auto &&block : m_batch) {
+            const timeValueUs time = block->m_times[scanIndex];
+            const uint16_t code = block->m_codes[scanIndex];
+            scanChannel.m_channel->setSample(time, code);
+            if (!scanChannel.m_integrator->add(time, scanChannel.m_channel->fixed(code), m_voltageDelayLine) &&
+                (time >= startSampleTimeUs))
+                ++missingVoltage;
+        }
+        m_missingVoltage[currentIndex] += missingVoltage;
+    };
+
+    // a scan which does not follow the previous one, the time went back or stopped for too long
+    auto discontinuous = [&](timeValueUs scanStartUs) {
+        return (scanStartUs < m_prevScanEndUs) || (scanStartUs > m_prevScanEndUs + MAX_SCAN_GAP_US);
+    };
+    auto scanStart = [](const SampleBlock &block) {
+        return *std::min_element(block.m_times.begin(), block.m_times.end());
+    };
+    auto scanEnd = [](const SampleBlock &block) {
+        return *std::max_element(block.m_times.begin(), block.m_times.end());
+    };
+
+    bool done = false;
+
+    // take the scans from the acquisition and write to channels
+    while (!done) {
+        SampleBlock *block = blocks.front();
+        if (!block) {
+            if (!m_acquisition->running()) throw std::runtime_error("Acquisition stopped");
+            if (stopRequested()) return false;
+            std::this_thread::sleep_for(BLOCK_WAIT_TIME);
+            continue;
         }
 
-        for (auto &&index : indices) index = 0;
-
-        chipID = channel->chipID();
-        channel->setSample(times[chipID][indices[chipID]], values[chipID][indices[chipID]]);
-        indices[chipID]++;
+        // samples need to be continuous, if scans were dropped or there is a gap (e.g. from a replayed capture)
+        // start again
+        const timeValueUs scanStartUs = scanStart(*block);
+        if (!m_windowContinues) {
+            startWindow(scanStartUs, false);
+        } else if (block->m_sequence != m_nextSequence) {
+            Log(WARN) << "Dropped " << block->m_sequence - m_nextSequence << " scans, restarting the window";
+            startWindow(scanStartUs, true);
+        } else if (discontinuous(scanStartUs)) {
+            Log(WARN) << "Gap of " << (int64_t)(scanStartUs - m_prevScanEndUs)
+                      << " us between scans, restarting the window";
+            startWindow(scanStartUs, true);
+        }
+        if (periodsLeft == 0) {
+            // the periods closed by the restart completed the window, the next one starts from scratch
+            done = true;
+            m_windowContinues = false;
+            break;
+        }
 
-        chipID = m_voltageChannel->chipID();
-        m_voltageChannel->setSample(times[chipID][indices[chipID]], values[chipID][indices[chipID]]);
-        indices[chipID]++;
+        // The voltage of the available scans goes to the delay line first, then the current channels take the
+        // batch in parallel. A batch ends with a zero crossing, so each integrator gets at most one period mark
+        // ahead of its samples. After the last period of the window the scans are taken one by one until the
+        // integrators are done, as the next window starts there.
+        const size_t maxBatch = (zeroCrossings > periodsLeft) ? 1 : MAX_BATCH;
+        m_batch.clear();
+        for (const SampleBlock *next = block; next; next = blocks.front(m_batch.size())) {
+            // a scan which restarts the window starts the next batch
+            if (!m_batch.empty() && ((next->m_sequence != m_nextSequence) || discontinuous(scanStart(*next)))) break;
+            m_nextSequence = next->m_sequence + 1;
+            m_prevScanEndUs = scanEnd(*next);
+            m_batch.push_back(next);
+            if (addVoltage(*next) || (m_batch.size() == maxBatch)) break;
+        }
 
-    } while (endTimeUs - startTimeUs < sampleTimeUs);
+        m_workers->run(m_currentScanIndexes.size(), integrateChannel);
+        blocks.pop(m_batch.size());
 
-    // back to standart priority
-    scheduler.reset();
+        done = true;
+        for (auto &&integrator : m_integrators) done &= integrator.done();
+        if (m_prevScanEndUs > timeoutUs) break;
+    }
 
-#if 0
-    // find zero-crossing
-    startTimeUs = 0;
-    endTimeUs = 0;
-    auto prevPositive = m_voltageChannel->value(0) >= 0.f;
-    uint32_t halfPeriod = 0;
-    uint32_t periods = 0;
-    for (size_t index = 1; index < m_voltageChannel->sampleCount(); ++index)
-    {
-        const auto value = m_voltageChannel->value(index);
-        const auto curPositive = value >= 0.f;
-        if (curPositive != prevPositive)
-        {
-            const auto timeUs = m_voltageChannel->sampleTime(index);
-            if (startTimeUs == 0)
-            {
-                startTimeUs = timeUs;
-            }
-            else
-            {
-                ++halfPeriod;
-                if ((halfPeriod & 1) == 0)
-                {
-                    endTimeUs = timeUs;
-                    ++periods;
-                }
-            }
-            prevPositive = curPositive;
-        }
+    // nothing to scan until the next window
+    if (!m_continuous) m_acquisition->pause();
+    m_acquisition->logEvents();
+
+    uint32_t missingVoltage = 0;
+    for (auto &&missing : m_missingVoltage) missingVoltage += missing;
+    if (missingVoltage)
+        Log(ERROR) << "Voltage for " << missingVoltage
+                   << " current samples not available, increase the voltage delay line size";
+    if (!done) {
+        Log(ERROR) << "Only found " << zeroCrossings << " zero crossings of the voltage";
+        // the integrators are not at a period boundary, the next window starts from scratch
+        m_windowContinues = false;
     }
-    //Log(DEBUG) << "Found " << periods << " periods, frequency " << periods / ((endTimeUs - startTimeUs) / 1000000.f) << " Hz";
-#endif
 
-    // calculate power
-    voltageChannel->clearSamples();
-    {
-        // Log(DEBUG) << "Samples [" << channel->chipID() << ":" <<
-        // channel->channelID() << "] " << channel->sampleCount();
-
-        float p = 0.f;
-        // float i = 0.f;
-        // float u = 0.f;
-
-        // set the sample interval to start one period after the first sample
-        // and also leave one period space at the end. This is to have space for
-        // the phase correction.
-        const timeValueUs startSampleTimeUs = channel->sampleTime(0) + LINE_PERIOD_TIME_US;
-        const timeValueUs endSampleTimeUs = startSampleTimeUs + PERIODS_TO_READ * LINE_PERIOD_TIME_US;
-        for (size_t index = 0; index < channel->sampleCount() - 1; ++index) {
-            const timeValueUs time = channel->sampleTime(index);
-            // check if the time is in the interval, else continue with next
-            // sample
-            if (time < startSampleTimeUs) continue;
-            // get the time of the next sample
-            const timeValueUs nextTime = channel->sampleTime(index + 1);
-            // if the next time is outside of the interval we are done
-            if (nextTime > endSampleTimeUs) break;
-
-            // get the current
-            const float current = channel->value(index);
-            // get the voltage at the time modified by the phase
-            const auto voltageTime = time + channel->timeOffset() - CAL_PHASE_CORRECTION;
-            // if the voltage time is outside of the interval we are done
-            if ((voltageTime > endTimeUs) || (voltageTime < startTimeUs))
-                Log(ERROR) << "Voltage time " << voltageTime << "out of range (" << startSampleTimeUs << ", "
-                           << endSampleTimeUs << ")";
-            const float voltage = m_voltageChannel->sampleAtTime(voltageTime);
-            // write to voltage channel for this current
-            voltageChannel->setSample(voltageTime, voltage);
-
-            // i += current * current * (nextTime - time);
-            // u += voltage * voltage * (nextTime - time);
-            p += (voltage * current) * (nextTime - time);
-        }
+    // the values are stamped with the wall clock time of the end of the window, the mapping follows NTP steps
+    ClockMapping::getInstance().calibrate();
+    const timeValueUs timestamp = m_acquisition->toWallTime(m_prevScanEndUs);
 
-        const float invTimeRangeUs = 1.f / (float)(endSampleTimeUs - startSampleTimeUs);
-        p *= invTimeRangeUs;
+    if (zeroCrossings > 1)
+        m_frequency.set((float)(zeroCrossings - 1) * 1000000.f / (float)(m_lastZeroCrossingUs - firstZeroCrossingUs),
+                        timestamp);
 
-        // u *= invTimeRangeUs;
-        // u = std::sqrt(u);
-        // i *= invTimeRangeUs;
-        // i = std::sqrt(i);
-        // Log(DEBUG) << channel->name() << ": U " << u << " I " << i << " P "
-        // << p;
+    // the values of all channels are ready when the window closes
+    auto itIntegrator = m_integrators.begin();
+    auto itRms = m_rmsChannels.begin();
+    for (auto &&channel : m_currentChannels) {
+        if (itIntegrator->periods() != m_periodsToRead)
+            Log(WARN) << channel->name() << ": integrated " << itIntegrator->periods() << " of " << m_periodsToRead
+                      << " periods";
+        channel->set(itIntegrator->power(), timestamp);
+        itRms->m_voltage.set(itIntegrator->voltageRms(), timestamp);
+        itRms->m_current.set(itIntegrator->currentRms(), timestamp);
+        itRms->m_apparentPower.set(itIntegrator->apparentPower(), timestamp);
+        itRms->m_powerFactor.set(itIntegrator->powerFactor(), timestamp);
+        ++itIntegrator;
+        ++itRms;
+    }
 
-        channel->set(p);
+    if (m_energyCounter) {
+        size_t index = 0;
+        auto itEnergy = m_energyChannels.begin();
+        for (auto &&integrator : m_integrators) {
+            m_energyCounter->add(index, integrator.energy());
+            itEnergy->set(m_energyCounter->wh(index) / 1000.0, timestamp);
+            ++index;
+            ++itEnergy;
+        }
     }
+
+    return true;
 }
 
 void Power::preStart() {
-#ifdef BCM2835
-    if (!bcm2835_init()) throw std::runtime_error("Failed to init BCM 2835");
-
-    if (!bcm2835_spi_begin()) throw std::runtime_error("bcm2835_spi_begin() failed");
-
-    bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
-    bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // Data comes in on falling
-                                                                  // edge
-    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_2048);  // 19.2MHz / 2048 = 9.375kHz
-    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
-    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS1, LOW);
-#elif defined(WIRINGPI)
-    const int speed = 1 * 1000 * 1000;
-    if (wiringPiSetup() == -1) throw std::runtime_error("Failed to setup WiringPI");
-    int fd;
-    fd = wiringPiSPISetup(0, speed);
-    if (fd == -1) throw std::runtime_error("Failed to setup SPI channel 0");
-    m_fds.push_back(fd);
-    fd = wiringPiSPISetup(1, speed);
-    if (fd == -1) throw std::runtime_error("Failed to setup SPI channel 1");
-    m_fds.push_back(fd);
-#endif
+    // without continuous measurement each update resumes the scans for its window
+    if (!m_continuous) m_acquisition->pause();
+    m_acquisition->start();
 }
 
-void Power::threadFunction() {
+void Power::publish() {
     std::vector<const ChannelAD *> channelsAD;
-    auto itCurrent = m_currentChannels.begin();
-    auto itVoltage = m_voltageChannels.begin();
-    while (itCurrent != m_currentChannels.end()) {
-        update(*itCurrent, *itVoltage);
-
-        channelsAD.push_back(itCurrent->get());
-        channelsAD.push_back(itVoltage->get());
-
-        ++itCurrent;
-        ++itVoltage;
+    for (auto &&channel : m_currentChannels) {
+        channelsAD.push_back(channel.get());
     }
 
     std::vector<const Channel *> channels;
+    channels.push_back(&m_frequency);
     for (auto &&channel : m_currentChannels) {
         channels.push_back(channel.get());
     }
+    for (auto &&channel : m_rmsChannels) {
+        channels.push_back(&channel.m_voltage);
+        channels.push_back(&channel.m_current);
+        channels.push_back(&channel.m_apparentPower);
+        channels.push_back(&channel.m_powerFactor);
+    }
+    for (auto &&channel : m_energyChannels) {
+        channels.push_back(&channel);
+    }
     for (auto &&channel : m_channels) {
         channel->update();
         channels.push_back(channel.get());
     }
+    for (auto &&channel : m_energySumChannels) {
+        channel->update();
+        channels.push_back(channel.get());
+    }
 
     post(channels);
 
-    Server::getInstance().update(channelsAD);
+    Server::getInstance().update(channelsAD, m_voltageViews, channels);
+
+    if (m_acquisition->paced()) Log(INFO) << "Scan start jitter " << m_acquisition->takeJitter().toString();
 }
 
-void Power::postStop() {
-#ifdef BCM2835
-    bcm2835_spi_end();
-    if (!bcm2835_close()) throw std::runtime_error("bcm2835_close() failed");
-#elif defined(WIRINGPI)
-    for (auto &&fd : m_fds) close(fd);
-    m_fds.clear();
-#endif
+void Power::threadFunction() {
+    if (!m_continuous) {
+        // one window for all channels, the sum channels are built from values taken at the same time
+        if (update()) publish();
+        return;
+    }
+
+    // The windows follow each other until the task is stopped, the last window is published once per update period.
+    // Publishing may block, the acquisition buffers the scans meanwhile.
+    timeValueUs nextPublishUs = 0;
+    while (!stopRequested()) {
+        if (!update()) break;
+
+        // the publish interval must not change when the wall clock is set
+        const timeValueUs nowUs = monotonicTime();
+        if (nowUs >= nextPublishUs) {
+            publish();
+            m_energyCounter->save();
+            nextPublishUs =
+                nowUs + std::chrono::duration_cast<std::chrono::microseconds>(Options::getInstance().updatePeriod())
+                            .count();
+        }
+    }
+    m_energyCounter->save();
 }
+
+void Power::postStop() { m_acquisition->stop(); }
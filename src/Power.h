@@ -3,8 +3,12 @@
 
 #include <list>
 
+#include "Acquisition.h"
 #include "BackgroundTask.h"
 #include "Channel.h"
+#include "EnergyCounter.h"
+#include "Integrator.h"
+#include "WorkerPool.h"
 
 class Power : public BackgroundTask {
    public:
@@ -12,22 +16,85 @@ class Power : public BackgroundTask {
     virtual ~Power();
 
    private:
-#ifdef WIRINGPI
-    std::vector<int> m_fds;
-#endif
+    std::unique_ptr<Acquisition> m_acquisition;
 
     std::list<std::unique_ptr<ChannelSum>> m_channels;
 
     std::list<std::unique_ptr<ChannelAD>> m_currentChannels;
-    std::list<std::unique_ptr<ChannelAD>> m_voltageChannels;
     std::unique_ptr<ChannelAD> m_voltageChannel;
+    // for each current channel the voltage used for the integration, read from the voltage channel
+    std::vector<ChannelADView> m_voltageViews;
+
+    // RMS voltage, RMS current, apparent power and power factor of a current channel
+    struct RmsChannels {
+        explicit RmsChannels(const std::string &name)
+            : m_voltage(name + "_urms"),
+              m_current(name + "_irms"),
+              m_apparentPower(name + "_va"),
+              m_powerFactor(name + "_pf") {}
+
+        Channel m_voltage;
+        Channel m_current;
+        Channel m_apparentPower;
+        Channel m_powerFactor;
+    };
+    std::list<RmsChannels> m_rmsChannels;
+
+    // measured line frequency
+    Channel m_frequency;
+
+    // In continuous mode the windows follow each other without a gap and the energy of each window is added to
+    // the counters. The values are published once per update period.
+    bool m_continuous;
+    std::unique_ptr<EnergyCounter> m_energyCounter;
+    // cumulative energy of the current channels and the sum channels (kWh)
+    std::list<Channel> m_energyChannels;
+    std::list<std::unique_ptr<ChannelSum>> m_energySumChannels;
+
+    // how many line periods to integrate
+    uint32_t m_periodsToRead;
+
+    // one integrator for each current channel
+    std::vector<PowerIntegrator> m_integrators;
+    // recent samples of the voltage channel
+    VoltageDelayLine m_voltageDelayLine;
+    ZeroCrossingDetector m_zeroCrossingDetector;
+
+    // a channel in the scan, 'integrator' is null for the voltage channel
+    struct ScanChannel {
+        ChannelAD *m_channel;
+        PowerIntegrator *m_integrator;
+    };
+    // in the order of the samples in a SampleBlock
+    std::vector<ScanChannel> m_scanChannels;
+    // position of the voltage channel and of each current channel (in the order of the integrators) in the scan
+    size_t m_voltageScanIndex;
+    std::vector<size_t> m_currentScanIndexes;
+
+    // The current channels of a batch of scans are integrated in parallel, each task takes one channel
+    std::unique_ptr<WorkerPool> m_workers;
+    std::vector<const SampleBlock *> m_batch;
+    // count of current samples without voltage for each current channel
+    std::vector<uint32_t> m_missingVoltage;
+
+    // state kept between windows in continuous mode
+    bool m_windowContinues;
+    uint64_t m_nextSequence;
+    timeValueUs m_prevScanEndUs;
+    timeValueUs m_lastZeroCrossingUs;
 
     // reference voltage
     float m_refVoltage;
     // AD inputs are offset by this voltage so that DC voltages can be measured
     float m_adcOffsetVoltage;
 
-    void update(std::unique_ptr<ChannelAD> &channel, std::unique_ptr<ChannelAD> &voltageChannel);
+    /**
+     * Read one window and update the channels
+     *
+     * @returns false if the window is incomplete because the task is stopped
+     */
+    bool update();
+    void publish();
 
     virtual void preStart();
     virtual void postStop();
@@ -0,0 +1,143 @@
+#include "PowerKernel.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define POWER_KERNEL_NEON
+#include <arm_neon.h>
+#if defined(__arm__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#elif defined(__SSE2__)
+#define POWER_KERNEL_SSE
+#include <emmintrin.h>
+#endif
+
+namespace PowerKernel {
+
+static const size_t LANES = 4;
+
+void scalar(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count, int64_t sums[3]) {
+    int64_t p = 0;
+    int64_t u2 = 0;
+    int64_t i2 = 0;
+
+    for (size_t index = 0; index < count; ++index) {
+        const int32_t u = voltage[index];
+        const int32_t i = current[index];
+        const int64_t t = time[index];
+        p += (int64_t)(u * i) * t;
+        u2 += (int64_t)(u * u) * t;
+        i2 += (int64_t)(i * i) * t;
+    }
+
+    sums[0] += p;
+    sums[1] += u2;
+    sums[2] += i2;
+}
+
+#if defined(POWER_KERNEL_NEON)
+
+static void neon(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count, int64_t sums[3]) {
+    int64x2_t p = vdupq_n_s64(0);
+    int64x2_t u2 = vdupq_n_s64(0);
+    int64x2_t i2 = vdupq_n_s64(0);
+
+    size_t index = 0;
+    for (; index + LANES <= count; index += LANES) {
+        const int16x4_t u = vld1_s16(voltage + index);
+        const int16x4_t i = vld1_s16(current + index);
+        const int32x4_t t = vld1q_s32(time + index);
+        const int32x2_t tLow = vget_low_s32(t);
+        const int32x2_t tHigh = vget_high_s32(t);
+
+        const int32x4_t ui = vmull_s16(u, i);
+        p = vmlal_s32(vmlal_s32(p, vget_low_s32(ui), tLow), vget_high_s32(ui), tHigh);
+        const int32x4_t uu = vmull_s16(u, u);
+        u2 = vmlal_s32(vmlal_s32(u2, vget_low_s32(uu), tLow), vget_high_s32(uu), tHigh);
+        const int32x4_t ii = vmull_s16(i, i);
+        i2 = vmlal_s32(vmlal_s32(i2, vget_low_s32(ii), tLow), vget_high_s32(ii), tHigh);
+    }
+
+    sums[0] += vgetq_lane_s64(p, 0) + vgetq_lane_s64(p, 1);
+    sums[1] += vgetq_lane_s64(u2, 0) + vgetq_lane_s64(u2, 1);
+    sums[2] += vgetq_lane_s64(i2, 0) + vgetq_lane_s64(i2, 1);
+    scalar(voltage + index, current + index, time + index, count - index, sums);
+}
+
+const Function simd = neon;
+const char *const simdName = "NEON";
+
+bool simdSupported() {
+#if defined(__arm__)
+    // 32 bit ARM, the Raspberry Pi 1 and Zero have no NEON
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return true;
+#endif
+}
+
+#elif defined(POWER_KERNEL_SSE)
+
+// Product of the signed 32 bit values in lanes 0 and 2 of 'a' with the not negative values in lanes 0 and 2 of 't' as
+// two 64 bit values. SSE2 only has the unsigned multiplication, for a negative 'a' it is too large by t << 32.
+static inline __m128i mulSigned(__m128i a, __m128i t) {
+    const __m128i negative = _mm_srai_epi32(a, 31);
+    return _mm_sub_epi64(_mm_mul_epu32(a, t), _mm_slli_epi64(_mm_and_si128(negative, t), 32));
+}
+
+static void sse(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count, int64_t sums[3]) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i p = zero;
+    __m128i u2 = zero;
+    __m128i i2 = zero;
+
+    size_t index = 0;
+    for (; index + LANES <= count; index += LANES) {
+        // the samples as 32 bit lanes with the upper half zero, madd gives the exact 32 bit products
+        const __m128i u = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(voltage + index)), zero);
+        const __m128i i = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(current + index)), zero);
+        const __m128i t = _mm_loadu_si128((const __m128i *)(time + index));
+        const __m128i tOdd = _mm_srli_epi64(t, 32);
+
+        const __m128i ui = _mm_madd_epi16(u, i);
+        p = _mm_add_epi64(p, _mm_add_epi64(mulSigned(ui, t), mulSigned(_mm_srli_epi64(ui, 32), tOdd)));
+        // the squares are not negative
+        const __m128i uu = _mm_madd_epi16(u, u);
+        u2 = _mm_add_epi64(u2, _mm_add_epi64(_mm_mul_epu32(uu, t), _mm_mul_epu32(_mm_srli_epi64(uu, 32), tOdd)));
+        const __m128i ii = _mm_madd_epi16(i, i);
+        i2 = _mm_add_epi64(i2, _mm_add_epi64(_mm_mul_epu32(ii, t), _mm_mul_epu32(_mm_srli_epi64(ii, 32), tOdd)));
+    }
+
+    int64_t lanes[3][2];
+    _mm_storeu_si128((__m128i *)lanes[0], p);
+    _mm_storeu_si128((__m128i *)lanes[1], u2);
+    _mm_storeu_si128((__m128i *)lanes[2], i2);
+    for (size_t sum = 0; sum < 3; ++sum) sums[sum] += lanes[sum][0] + lanes[sum][1];
+    scalar(voltage + index, current + index, time + index, count - index, sums);
+}
+
+const Function simd = sse;
+const char *const simdName = "SSE";
+
+bool simdSupported() { return true; }
+
+#else
+
+const Function simd = scalar;
+const char *const simdName = "scalar";
+
+bool simdSupported() { return false; }
+
+#endif
+
+static Function s_selected = scalar;
+
+void select(bool useSimd) { s_selected = (useSimd && simdSupported()) ? simd : scalar; }
+
+const char *selectedName() { return (s_selected == scalar) ? "scalar" : simdName; }
+
+void integrate(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count, int64_t sums[3]) {
+    s_selected(voltage, current, time, count, sums);
+}
+
+}  // namespace PowerKernel
@@ -0,0 +1,39 @@
+#ifndef POWER_KERNEL_H
+#define POWER_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Sums over a block of samples, used by PowerIntegrator. For each sample i
+ *   sums[0] += voltage[i] * current[i] * time[i]
+ *   sums[1] += voltage[i] * voltage[i] * time[i]
+ *   sums[2] += current[i] * current[i] * time[i]
+ * The products of two samples fit into 32 bits, the time is not negative. The sums are exact, so all kernels give
+ * identical results.
+ */
+namespace PowerKernel {
+
+using Function = void (*)(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count,
+                          int64_t sums[3]);
+
+void scalar(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count, int64_t sums[3]);
+
+// the SIMD kernel of the platform (NEON or SSE), the scalar kernel if there is none
+extern const Function simd;
+// name of the SIMD kernel
+extern const char *const simdName;
+// false if the SIMD kernel is not supported by the CPU the program runs on
+bool simdSupported();
+
+/**
+ * Select the kernel used by integrate(), the SIMD kernel is used if 'useSimd' is set and it is supported
+ */
+void select(bool useSimd);
+const char *selectedName();
+
+void integrate(const int16_t *voltage, const int16_t *current, const int32_t *time, size_t count, int64_t sums[3]);
+
+}  // namespace PowerKernel
+
+#endif  // POWER_KERNEL_H
@@ -0,0 +1,30 @@
+#include "RealTimeSection.h"
+
+#ifndef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <exception>
+#include <new>
+
+static thread_local uint64_t t_allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++t_allocations;
+    void *memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+RealTimeSection::RealTimeSection() : m_allocations(t_allocations) {}
+
+RealTimeSection::~RealTimeSection() {
+    // an exception leaving the section may allocate, the thread stops then anyway
+    assert(std::uncaught_exception() || (t_allocations == m_allocations));
+}
+
+uint64_t RealTimeSection::allocations() { return t_allocations; }
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef REAL_TIME_SECTION_H
+#define REAL_TIME_SECTION_H
+
+#include <cstdint>
+
+/**
+ * Marks a scope on the real time thread which must not allocate memory, allocator locks and page faults would delay
+ * the scan. In debug builds the global operator new counts the allocations of each thread and leaving the scope
+ * asserts that there were none. In release builds it does nothing.
+ */
+class RealTimeSection {
+   public:
+#ifndef NDEBUG
+    RealTimeSection();
+    ~RealTimeSection();
+
+    // count of allocations of the calling thread
+    static uint64_t allocations();
+
+   private:
+    uint64_t m_allocations;
+#endif
+};
+
+#endif  // REAL_TIME_SECTION_H
@@ -5,6 +5,7 @@
 #include <memory>
 #include <mutex>
 #include <list>
+#include <map>
 #include <set>
 #include <mutex>
 #include <array>
@@ -40,6 +41,15 @@ public:
 
     std::mutex m_mutex;
     std::list<ChannelAD> m_channels;
+    std::vector<ChannelADView> m_views;
+
+    struct Reading
+    {
+        std::string m_name;
+        float m_value;
+        timeValueUs m_timestamp;
+    };
+    std::vector<Reading> m_readings;
 };
 
 Server &Server::getInstance()
@@ -137,6 +147,10 @@ void Server::Impl::messageHandler(websocketpp::connection_hdl hdl, WebServer::me
                 {
                     names.push_back(channel.name());
                 }
+                for (auto &&view: m_views)
+                {
+                    names.push_back(view.name());
+                }
             }
 
             payload["type"] = "Names";
@@ -164,9 +178,37 @@ void Server::Impl::messageHandler(websocketpp::connection_hdl hdl, WebServer::me
                         break;
                     }
                 }
+                for (auto &&view: m_views)
+                {
+                    if (view.name() == name)
+                    {
+                        size_t cursor = 0;
+                        for (size_t index = 0; index < view.sampleCount(); ++index)
+                        {
+                            const std::array<float, 2> sample = { { static_cast<float>(view.sampleTime(index) - view.sampleTime(0)), view.value(index, cursor) } };
+                            values.emplace_back(sample);
+                        }
+                        break;
+                    }
+                }
             }
             payload["data"]["values"] = values;
         }
+        else if (type == "GetReadings")
+        {
+            nlohmann::json readings = nlohmann::json::array();
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                for (auto &&reading: m_readings)
+                {
+                    readings.push_back({ { "name", reading.m_name }, { "value", reading.m_value }, { "timestamp", reading.m_timestamp } });
+                }
+            }
+
+            payload["type"] = "Readings";
+            payload["data"]["readings"] = readings;
+        }
         else
         {
             std::stringstream error;
@@ -188,13 +230,37 @@ void Server::Impl::threadLoop()
     m_endpoint.run();
 }
 
-void Server::update(const std::vector<const ChannelAD*> &channels)
+void Server::update(const std::vector<const ChannelAD*> &channels, const std::vector<ChannelADView> &views,
+    const std::vector<const Channel*> &readings)
 {
     std::unique_lock<std::mutex> lock(m_impl->m_mutex);
 
+    // the copy of each channel, the views are moved to the copies
+    std::map<const ChannelAD*, const ChannelAD*> copies;
+    auto copy = [this, &copies](const ChannelAD *channel) -> const ChannelAD*
+    {
+        auto it = copies.find(channel);
+        if (it != copies.end())
+            return it->second;
+        m_impl->m_channels.emplace_back(*channel);
+        copies[channel] = &m_impl->m_channels.back();
+        return copies[channel];
+    };
+
+    m_impl->m_views.clear();
     m_impl->m_channels.clear();
     for (auto &&channel: channels)
     {
-        m_impl->m_channels.emplace_back(*channel);
+        copy(channel);
+    }
+    for (auto &&view: views)
+    {
+        m_impl->m_views.emplace_back(view, copy(view.source()), copy(view.timeBase()));
+    }
+
+    m_impl->m_readings.clear();
+    for (auto &&reading: readings)
+    {
+        m_impl->m_readings.push_back({ reading->name(), reading->value(), reading->timestamp() });
     }
 }
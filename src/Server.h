@@ -4,14 +4,21 @@
 #include <memory>
 #include <vector>
 
+class Channel;
 class ChannelAD;
+class ChannelADView;
 
 class Server
 {
 public:
     static Server &getInstance();
 
-    void update(const std::vector<const ChannelAD*> &channels);
+    /**
+     * Update the sample data of 'channels' and 'views' and the values of 'readings'. The channels the views read
+     * from are copied once.
+     */
+    void update(const std::vector<const ChannelAD*> &channels, const std::vector<ChannelADView> &views,
+        const std::vector<const Channel*> &readings);
 
     void shutdown();
 
@@ -25,3 +25,8 @@ const nlohmann::json::const_reference Settings::get(const std::string &key) cons
 {
     return m_json.at(key);
 }
+
+bool Settings::has(const std::string &key) const
+{
+    return m_json.count(key) != 0;
+}
@@ -12,6 +12,7 @@ public:
     static Settings &getInstance();
 
     const nlohmann::json::const_reference get(const std::string &key) const; 
+    bool has(const std::string &key) const;
 
 private:
     // this is a singleton, hide copy constructor etc.
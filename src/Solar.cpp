@@ -2,18 +2,43 @@
 #include "Channel.h"
 #include "Post.h"
 #include "Options.h"
+#include "Settings.h"
 #include "Log.h"
 
 #include <curlpp/cURLpp.hpp>
 #include <curlpp/Easy.hpp>
 #include <curlpp/Options.hpp>
 
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 
+// converters asked if there are no 'solar' settings
 static const uint32_t START_ADDRESS = 1;
 static const uint32_t END_ADDRESS = 3;
-static const uint32_t NUM_CONVERTER = END_ADDRESS - START_ADDRESS + 1;
+// time for a converter to reply
+static const std::chrono::milliseconds REPLY_TIMEOUT(1000);
+
+// Channel name for 'value' of the converter at 'address', e.g. solar_udc_1. The power and the energy of today keep
+// their names solar_w1 and solar_kwh1. A channel publishes one number per code: the first field times the factor of
+// the code for scalar codes, so only the operating state of the two fields of SYS, and the error code of the record
+// for the error codes EC00 to EC08. The statistics codes have several numbers and can not be published.
+static std::string channelName(const SolarMax::Value &value, uint32_t address)
+{
+    std::ostringstream name;
+    if (value.code() == SolarMax::Code::CODE_PAC)
+        name << "solar_w";
+    else if (value.code() == SolarMax::Code::CODE_KDY)
+        name << "solar_kwh";
+    else
+    {
+        std::string mnemonic(value.mnemonic());
+        std::transform(mnemonic.begin(), mnemonic.end(), mnemonic.begin(), ::tolower);
+        name << "solar_" << mnemonic << "_";
+    }
+    name << address;
+    return name.str();
+}
 
 Solar::Solar()
     : BackgroundTask(true)
@@ -25,23 +50,55 @@ Solar::Solar()
     m_channelSolar.push_back(std::unique_ptr<ChannelSum>(new ChannelSum("solar")));
     m_channelSolar.push_back(std::unique_ptr<ChannelSum>(new ChannelSum("solar_kwh")));
 
-    for (uint32_t address = START_ADDRESS; address <= END_ADDRESS; ++address)
+    // the converters and their codes, by default the power and the energy of today of converters 1 to 3
+    nlohmann::json converters;
+    auto &settings = Settings::getInstance();
+    if (settings.has("solar"))
     {
-        std::vector<std::unique_ptr<ChannelConverter>> channels;
-        std::unique_ptr<ChannelConverter> channel;
+        converters = settings.get("solar").at("converters");
+    }
+    else
+    {
+        for (uint32_t address = START_ADDRESS; address <= END_ADDRESS; ++address)
+            converters.push_back({{"address", address}, {"codes", {"PAC", "KDY"}}});
+    }
 
-        std::ostringstream name;
-        name << "solar_w" << address;
-        channel.reset(new ChannelConverter(name.str(), address, new SolarMax::Value("PAC")));
-        m_channelSolar[0]->add(channel.get());
-        channels.push_back(std::move(channel));
+    for (auto &&converter : converters)
+    {
+        const uint32_t address = converter.at("address");
+        std::vector<std::string> codes = converter.value("codes", std::vector<std::string>());
+
+        // the power and the energy of today are needed for the sums and the statistics
+        for (auto &&required : {"PAC", "KDY"})
+        {
+            if (std::find(codes.begin(), codes.end(), required) == codes.end())
+                codes.push_back(required);
+        }
+
+        std::vector<std::unique_ptr<ChannelConverter>> channels;
+        std::vector<SolarMax::Value*> values;
+        for (auto &&code : codes)
+        {
+            std::unique_ptr<SolarMax::Value> value(new SolarMax::Value(code));
+            if (SolarMax::codeInfo(value->code()).m_parser == SolarMax::Parser::STATISTIC)
+                throw std::runtime_error("Solar: The statistics code " + code + " can not be published as channel");
+
+            const std::string name = channelName(*value, address);
+            values.push_back(value.get());
+            std::unique_ptr<ChannelConverter> channel(new ChannelConverter(name, address, value.release()));
+            if (channel->value()->code() == SolarMax::Code::CODE_PAC)
+                m_channelSolar[0]->add(channel.get());
+            else if (channel->value()->code() == SolarMax::Code::CODE_KDY)
+                m_channelSolar[1]->add(channel.get());
+            channels.push_back(std::move(channel));
+        }
 
-        name.str("");
-        name << "solar_kwh" << address;
-        channel.reset(new ChannelConverter(name.str(), address, new SolarMax::Value("KDY")));
-        m_channelSolar[1]->add(channel.get());
-        channels.push_back(std::move(channel));
+        // all codes of a converter are asked with one request
+        char frame[SolarMax::MAX_FRAME_SIZE];
+        if (SolarMax::encodeRequest(values, address, frame) == 0)
+            throw std::runtime_error("Solar: Too many codes for converter " + std::to_string(address));
 
+        Log(INFO) << "Solar: Converter " << address << " codes " << nlohmann::json(codes).dump();
         m_channelsConverter.push_back(std::move(channels));
     }
 }
@@ -193,7 +250,7 @@ void Solar::writeStat()
     }
 }
 
-void Solar::updateStat()
+void Solar::updateStat(const std::vector<bool> &replied)
 {
     time_t curTime = time(nullptr);
     if (curTime == (time_t)-1)
@@ -213,29 +270,26 @@ void Solar::updateStat()
     // year is just 0 - 99
     localTime.tm_year %= 100;
 
-    // find the kwh channels and cacl the max kw for each converter
-    uint32_t address = START_ADDRESS;
+    // find the kwh channels and cacl the max kw of the converters which replied
+    const size_t converterCount = m_channelsConverter.size();
     std::vector<float> values;
     float fmax = 0.f;
-    for (auto&& channels: m_channelsConverter)
+    for (size_t index = 0; index < converterCount; ++index)
     {
-        std::ostringstream name;
-        name << "solar_kwh" << address;
-        for (auto &&channel : channels)
+        for (auto &&channel : m_channelsConverter[index])
         {
-            if (channel->name().compare(0, name.str().size(), name.str()) == 0)
+            if (channel->value()->code() == SolarMax::Code::CODE_KDY)
             {
                 values.push_back(channel->value()->value());
             }
-            else
+            else if ((channel->value()->code() == SolarMax::Code::CODE_PAC) && replied[index])
             {
                 fmax += channel->value()->value();
             }
         }
-        address++;
     }
 
-    if (values.size() != NUM_CONVERTER)
+    if (values.size() != converterCount)
         throw std::runtime_error("Address and converter value mismatch");
 
     // check if the day is already in the array
@@ -245,7 +299,7 @@ void Solar::updateStat()
         newStat.m_day = localTime.tm_mday;
         newStat.m_month = localTime.tm_mon;
         newStat.m_year = localTime.tm_year;
-        newStat.m_values.resize(NUM_CONVERTER);
+        newStat.m_values.resize(converterCount);
         m_days.push_front(newStat);
 
         m_max = 0.f;
@@ -261,9 +315,12 @@ void Solar::updateStat()
     }
 
     Stat &day = m_days.front();
+    day.m_values.resize(converterCount);
     for (size_t index = 0; index < values.size(); ++index)
     {
-        day.m_values[index] = (uint32_t)(values[index] * 1000.f + 0.5f);
+        // a converter which did not reply keeps the energy stored for today, its value may be from yesterday
+        if (replied[index])
+            day.m_values[index] = (uint32_t)(values[index] * 1000.f + 0.5f);
     }
 
     // check if the month is already in the array
@@ -273,7 +330,7 @@ void Solar::updateStat()
         newStat.m_day = localTime.tm_mday;
         newStat.m_month = localTime.tm_mon;
         newStat.m_year = localTime.tm_year;
-        newStat.m_values.resize(NUM_CONVERTER);
+        newStat.m_values.resize(converterCount);
         m_months.push_front(newStat);
     }
 
@@ -300,7 +357,7 @@ void Solar::updateStat()
         newStat.m_day = localTime.tm_mday;
         newStat.m_month = localTime.tm_mon;
         newStat.m_year = localTime.tm_year;
-        newStat.m_values.resize(NUM_CONVERTER);
+        newStat.m_values.resize(converterCount);
         m_years.push_front(newStat);
     }
 
@@ -332,48 +389,60 @@ void Solar::preStart()
 
 void Solar::threadFunction()
 {
-    uint32_t activeConverter = 0;
+    std::vector<SolarMax::Request> requests;
     for (auto &&channels : m_channelsConverter)
     {
-        std::vector<SolarMax::Value*> values;
-        uint32_t address = 0;
+        SolarMax::Request request;
+        request.m_address = 0;
 
         for (auto &&channel : channels)
         {
-            if (address == 0)
-                address = channel->address();
-            else if(address != channel->address())
+            if (request.m_address == 0)
+                request.m_address = channel->address();
+            else if(request.m_address != channel->address())
                 throw std::runtime_error("Channels of one group need to have the same address");
 
-            values.push_back(channel->value());
+            request.m_values.push_back(channel->value());
         }
 
-        if (SolarMax::askConverter(address, values))
-        {
-            ++activeConverter;
-            for (auto &&channel : channels)
-                channel->set(channel->value()->value());
-        }
+        requests.push_back(request);
     }
 
-    if (activeConverter != 0)
+    // all converters are asked at the same time, the cycle takes as long as the slowest reply
+    std::vector<std::future<bool>> replies;
+    for (auto &&request : requests)
+        replies.push_back(m_client.ask(request, REPLY_TIMEOUT));
+
+    // only the converters which replied are published and added up, the values of the others are outdated
+    const timeValueUs timestamp = time();
+    uint32_t activeConverter = 0;
+    std::vector<bool> replied(replies.size(), false);
+    std::vector<const Channel*> channels;
+    for (size_t index = 0; index < replies.size(); ++index)
     {
-        std::vector<const Channel*> channels;
-        for (auto &&channelsConverter : m_channelsConverter)
+        if (replies[index].get())
         {
-            for (auto &&channel : channelsConverter)
+            ++activeConverter;
+            replied[index] = true;
+            for (auto &&channel : m_channelsConverter[index])
+            {
+                channel->set(channel->value()->value(), timestamp);
                 channels.push_back(channel.get());
+            }
         }
+    }
 
+    if (activeConverter != 0)
+    {
         for (auto &&channelSolar : m_channelSolar)
         {
-            channelSolar->update();
+            channelSolar->update(timestamp);
             channels.push_back(channelSolar.get());
         }
 
         post(channels);
 
-        updateStat();
+        updateStat(replied);
     }
     else
     {
@@ -411,119 +480,3 @@ void Solar::postStop()
         }
     }
 }
-
-enum class Code
-{
-    CODE_ADR,   // Address
-    CODE_TYP,   // Type
-    CODE_SWV,   // Software version
-    CODE_DDY,   // Date day
-    CODE_DMT,   // Date month
-    CODE_DYR,   // Date year
-    CODE_THR,   // Time hours
-    CODE_TMI,   // Time minutes
-    CODE_E11,   // Error 1, number
-    CODE_E1D,   // Error 1, day
-    CODE_E1M,   // Error 1, month
-    CODE_E1h,   // Error 1, hour
-    CODE_E1m,   // Error 1, minute
-    CODE_E21,   // Error 2, number
-    CODE_E2D,   // Error 2, day
-    CODE_E2M,   // Error 2, month
-    CODE_E2h,   // Error 2, hour
-    CODE_E2m,   // Error 2, minute
-    CODE_E31,   // Error 3, number
-    CODE_E3D,   // Error 3, day
-    CODE_E3M,   // Error 3, month
-    CODE_E3h,   // Error 3, hour
-    CODE_E3m,   // Error 3, minute
-    CODE_KHR,   // Operating hours
-    CODE_KDY,   // Energy today [kWh]
-    CODE_KLD,   // Energy last day [kWh]
-    CODE_KMT,   // Energy this month [kWh]
-    CODE_KLM,   // Energy last month [kWh]
-    CODE_KYR,   // Energy this year [kWh]
-    CODE_KLY,   // Energy last year [kWh]
-    CODE_KT0,   // Energy total [kWh]
-    CODE_LAN,   // Language
-    CODE_UDC,   // DC voltage [V]
-    CODE_UL1,   // AC voltage [V]
-    CODE_IDC,   // DC current [A]
-    CODE_IL1,   // AC current [A]
-    CODE_PAC,   // AC power [W]
-    CODE_PIN,   // Power installed [W]
-    CODE_PRL,   // AC power [%]
-    CODE_CAC,   // Start ups
-    CODE_FRD,   // ???
-    CODE_SCD,   // ???
-    CODE_SE1,   // ???
-    CODE_SE2,   // ???
-    CODE_SPR,   // ???
-    CODE_TKK,   // Temperature Heat Sink
-    CODE_TNF,   // Net frequency (Hz)
-    CODE_SYS,   // Operation State
-    CODE_BDN,   // Build number
-    CODE_EC00,  // Error-Code(?) 00
-    CODE_EC01,  // Error-Code(?) 01
-    CODE_EC02,  // Error-Code(?) 02
-    CODE_EC03,  // Error-Code(?) 03
-    CODE_EC04,  // Error-Code(?) 04
-    CODE_EC05,  // Error-Code(?) 05
-    CODE_EC06,  // Error-Code(?) 06
-    CODE_EC07,  // Error-Code(?) 07
-    CODE_EC08,  // Error-Code(?) 08
-    CODE_DD00,  // Statistic Day 0 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD01,  // Statistic Day 1 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD02,  // Statistic Day 2 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD03,  // Statistic Day 3 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD04,  // Statistic Day 4 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD05,  // Statistic Day 5 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD06,  // Statistic Day 6 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD07,  // Statistic Day 7 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD08,  // Statistic Day 8 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD09,  // Statistic Day 9 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD10,  // Statistic Day 10 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD11,  // Statistic Day 11 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD12,  // Statistic Day 12 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD13,  // Statistic Day 13 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD14,  // Statistic Day 14 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD15,  // Statistic Day 15 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD16,  // Statistic Day 16 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD17,  // Statistic Day 17 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD18,  // Statistic Day 18 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD19,  // Statistic Day 19 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD20,  // Statistic Day 20 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD21,  // Statistic Day 21 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD22,  // Statistic Day 22 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD23,  // Statistic Day 23 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD24,  // Statistic Day 24 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD25,  // Statistic Day 25 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD26,  // Statistic Day 26 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD27,  // Statistic Day 27 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD28,  // Statistic Day 28 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD29,  // Statistic Day 29 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DD30,  // Statistic Day 30 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM00,  // Statistic Month 0 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM01,  // Statistic Month 1 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM02,  // Statistic Month 2 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM03,  // Statistic Month 3 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM04,  // Statistic Month 4 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM05,  // Statistic Month 5 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM06,  // Statistic Month 6 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM07,  // Statistic Month 7 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM08,  // Statistic Month 8 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM09,  // Statistic Month 9 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM10,  // Statistic Month 10 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DM11,  // Statistic Month 11 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY00,  // Statistic Year 0 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY01,  // Statistic Year 1 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY02,  // Statistic Year 2 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY03,  // Statistic Year 3 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY04,  // Statistic Year 4 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY05,  // Statistic Year 5 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY06,  // Statistic Year 6 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY07,  // Statistic Year 7 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY08,  // Statistic Year 8 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-    CODE_DY09,  // Statistic Year 9 YYY0000,Yield kWh*10,Peak W*2,Hours*10
-};
-
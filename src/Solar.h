@@ -42,6 +42,8 @@ public:
     virtual ~Solar();
 
 private:
+    SolarMax::Client m_client;
+
     std::vector<std::vector<std::unique_ptr<ChannelConverter>>> m_channelsConverter;
 
     std::vector<std::unique_ptr<ChannelSum>> m_channelSolar;
@@ -85,7 +87,8 @@ private:
     void getStat(const std::string file, const std::string start, std::list<Stat> &stats) const;
     void putStat(const std::string file, const std::string start, const std::list<Stat> &stats) const;
 
-    void updateStat();
+    // 'replied' tells for each converter if its values are current
+    void updateStat(const std::vector<bool> &replied);
     void readStat();
     void writeStat();
 
@@ -1,97 +1,330 @@
 #include "SolarMax.h"
 #include "Log.h"
 
-#include <curl/curl.h>
-
-// had been renamed
-#ifndef CURLINFO_ACTIVESOCKET
-#define CURLINFO_ACTIVESOCKET CURLINFO_LASTSOCKET
-#endif
-
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
-#include <sstream>
-#include <iomanip>
 
 static const std::string IP_ADDR("192.168.178.123");
 static const uint32_t PORT = 12345;
+// delay before retrying a failed connection, doubled on each failure
+static const std::chrono::seconds MIN_RETRY_DELAY(10);
+static const std::chrono::seconds MAX_RETRY_DELAY(600);
+// address of this side of the connection
+static const uint32_t MASTER_ADDRESS = 0xFB;
+// characters of a frame without the codes: '{', 'XX;XX;LL', '|64:', '|', 'CCCC', '}'
+static const size_t FRAME_OVERHEAD = 19;
 
 namespace SolarMax
 {
 
-Value::Value(const std::string &code)
-    : m_code(code)
+// in the order of Code
+static constexpr CodeInfo CODES[] =
 {
-    if ((m_code == "PAC") || (m_code == "PIN"))
-    {
-        m_fvalue.m_factor = 0.5f;
-    }
-    else if ((m_code == "UDC") || (m_code == "UL1") || (m_code == "KDY") ||
-        (m_code == "KLD"))
-    {
-        m_fvalue.m_factor = 0.1f;
-    }
-    else if ((m_code == "IDC") || (m_code == "IL1"))
-    {
-        m_fvalue.m_factor = 0.01f;
-    }
-    else if (m_code == "TNF")
-    {
-        m_fvalue.m_factor = 10.f;
-    }
-    else if (m_code.compare(0, 2, "DD") == 0)
+    {"ADR", 1.f, Parser::SCALAR},
+    {"TYP", 1.f, Parser::SCALAR},
+    {"SWV", 1.f, Parser::SCALAR},
+    {"DDY", 1.f, Parser::SCALAR},
+    {"DMT", 1.f, Parser::SCALAR},
+    {"DYR", 1.f, Parser::SCALAR},
+    {"THR", 1.f, Parser::SCALAR},
+    {"TMI", 1.f, Parser::SCALAR},
+    {"E11", 1.f, Parser::SCALAR},
+    {"E1D", 1.f, Parser::SCALAR},
+    {"E1M", 1.f, Parser::SCALAR},
+    {"E1h", 1.f, Parser::SCALAR},
+    {"E1m", 1.f, Parser::SCALAR},
+    {"E21", 1.f, Parser::SCALAR},
+    {"E2D", 1.f, Parser::SCALAR},
+    {"E2M", 1.f, Parser::SCALAR},
+    {"E2h", 1.f, Parser::SCALAR},
+    {"E2m", 1.f, Parser::SCALAR},
+    {"E31", 1.f, Parser::SCALAR},
+    {"E3D", 1.f, Parser::SCALAR},
+    {"E3M", 1.f, Parser::SCALAR},
+    {"E3h", 1.f, Parser::SCALAR},
+    {"E3m", 1.f, Parser::SCALAR},
+    {"KHR", 1.f, Parser::SCALAR},
+    {"KDY", 0.1f, Parser::SCALAR},
+    {"KLD", 0.1f, Parser::SCALAR},
+    {"KMT", 1.f, Parser::SCALAR},
+    {"KLM", 1.f, Parser::SCALAR},
+    {"KYR", 1.f, Parser::SCALAR},
+    {"KLY", 1.f, Parser::SCALAR},
+    {"KT0", 1.f, Parser::SCALAR},
+    {"LAN", 1.f, Parser::SCALAR},
+    {"UDC", 0.1f, Parser::SCALAR},
+    {"UL1", 0.1f, Parser::SCALAR},
+    {"IDC", 0.01f, Parser::SCALAR},
+    {"IL1", 0.01f, Parser::SCALAR},
+    {"PAC", 0.5f, Parser::SCALAR},
+    {"PIN", 0.5f, Parser::SCALAR},
+    {"PRL", 1.f, Parser::SCALAR},
+    {"CAC", 1.f, Parser::SCALAR},
+    {"FRD", 1.f, Parser::SCALAR},
+    {"SCD", 1.f, Parser::SCALAR},
+    {"SE1", 1.f, Parser::SCALAR},
+    {"SE2", 1.f, Parser::SCALAR},
+    {"SPR", 1.f, Parser::SCALAR},
+    {"TKK", 1.f, Parser::SCALAR},
+    {"TNF", 0.01f, Parser::SCALAR},
+    {"SYS", 1.f, Parser::SCALAR},
+    {"BDN", 1.f, Parser::SCALAR},
+    {"EC00", 1.f, Parser::ERROR},
+    {"EC01", 1.f, Parser::ERROR},
+    {"EC02", 1.f, Parser::ERROR},
+    {"EC03", 1.f, Parser::ERROR},
+    {"EC04", 1.f, Parser::ERROR},
+    {"EC05", 1.f, Parser::ERROR},
+    {"EC06", 1.f, Parser::ERROR},
+    {"EC07", 1.f, Parser::ERROR},
+    {"EC08", 1.f, Parser::ERROR},
+    {"DD00", 1.f, Parser::STATISTIC},
+    {"DD01", 1.f, Parser::STATISTIC},
+    {"DD02", 1.f, Parser::STATISTIC},
+    {"DD03", 1.f, Parser::STATISTIC},
+    {"DD04", 1.f, Parser::STATISTIC},
+    {"DD05", 1.f, Parser::STATISTIC},
+    {"DD06", 1.f, Parser::STATISTIC},
+    {"DD07", 1.f, Parser::STATISTIC},
+    {"DD08", 1.f, Parser::STATISTIC},
+    {"DD09", 1.f, Parser::STATISTIC},
+    {"DD10", 1.f, Parser::STATISTIC},
+    {"DD11", 1.f, Parser::STATISTIC},
+    {"DD12", 1.f, Parser::STATISTIC},
+    {"DD13", 1.f, Parser::STATISTIC},
+    {"DD14", 1.f, Parser::STATISTIC},
+    {"DD15", 1.f, Parser::STATISTIC},
+    {"DD16", 1.f, Parser::STATISTIC},
+    {"DD17", 1.f, Parser::STATISTIC},
+    {"DD18", 1.f, Parser::STATISTIC},
+    {"DD19", 1.f, Parser::STATISTIC},
+    {"DD20", 1.f, Parser::STATISTIC},
+    {"DD21", 1.f, Parser::STATISTIC},
+    {"DD22", 1.f, Parser::STATISTIC},
+    {"DD23", 1.f, Parser::STATISTIC},
+    {"DD24", 1.f, Parser::STATISTIC},
+    {"DD25", 1.f, Parser::STATISTIC},
+    {"DD26", 1.f, Parser::STATISTIC},
+    {"DD27", 1.f, Parser::STATISTIC},
+    {"DD28", 1.f, Parser::STATISTIC},
+    {"DD29", 1.f, Parser::STATISTIC},
+    {"DD30", 1.f, Parser::STATISTIC},
+    {"DM00", 1.f, Parser::STATISTIC},
+    {"DM01", 1.f, Parser::STATISTIC},
+    {"DM02", 1.f, Parser::STATISTIC},
+    {"DM03", 1.f, Parser::STATISTIC},
+    {"DM04", 1.f, Parser::STATISTIC},
+    {"DM05", 1.f, Parser::STATISTIC},
+    {"DM06", 1.f, Parser::STATISTIC},
+    {"DM07", 1.f, Parser::STATISTIC},
+    {"DM08", 1.f, Parser::STATISTIC},
+    {"DM09", 1.f, Parser::STATISTIC},
+    {"DM10", 1.f, Parser::STATISTIC},
+    {"DM11", 1.f, Parser::STATISTIC},
+    {"DY00", 1.f, Parser::STATISTIC},
+    {"DY01", 1.f, Parser::STATISTIC},
+    {"DY02", 1.f, Parser::STATISTIC},
+    {"DY03", 1.f, Parser::STATISTIC},
+    {"DY04", 1.f, Parser::STATISTIC},
+    {"DY05", 1.f, Parser::STATISTIC},
+    {"DY06", 1.f, Parser::STATISTIC},
+    {"DY07", 1.f, Parser::STATISTIC},
+    {"DY08", 1.f, Parser::STATISTIC},
+    {"DY09", 1.f, Parser::STATISTIC},
+};
+
+static_assert(sizeof(CODES) / sizeof(CODES[0]) == static_cast<size_t>(Code::CODE_COUNT),
+    "An entry of CODES is missing");
+
+// The mnemonics have 3 or 4 characters, they are looked up with a multiplicative hash of the packed characters. The
+// multiplier is chosen so that the hash has no collisions for the known mnemonics.
+static const uint32_t HASH_BITS = 9;
+static const uint32_t HASH_MULTIPLIER = 0x959DD5FD;
+static const uint8_t NO_CODE = 0xFF;
+
+static constexpr uint32_t packMnemonic(const char *mnemonic)
+{
+    return (static_cast<uint32_t>(static_cast<uint8_t>(mnemonic[0])) << 24) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(mnemonic[1])) << 16) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(mnemonic[2])) << 8) |
+        static_cast<uint32_t>(static_cast<uint8_t>(mnemonic[3]));
+}
+
+static constexpr uint32_t hashMnemonic(uint32_t packed)
+{
+    return (packed * HASH_MULTIPLIER) >> (32 - HASH_BITS);
+}
+
+static constexpr bool collides(size_t first, size_t second)
+{
+    return (second != sizeof(CODES) / sizeof(CODES[0])) &&
+        ((hashMnemonic(packMnemonic(CODES[first].m_mnemonic)) == hashMnemonic(packMnemonic(CODES[second].m_mnemonic))) ||
+        collides(first, second + 1));
+}
+
+static constexpr bool isPerfectHash(size_t first)
+{
+    return (first == sizeof(CODES) / sizeof(CODES[0])) || (!collides(first, first + 1) && isPerfectHash(first + 1));
+}
+
+static_assert(static_cast<size_t>(Code::CODE_COUNT) < NO_CODE, "Too many codes for the hash table");
+static_assert(isPerfectHash(0), "HASH_MULTIPLIER needs to be changed to avoid collisions");
+
+// the index into CODES for each hash
+static const std::array<uint8_t, 1 << HASH_BITS> &hashTable()
+{
+    static const std::array<uint8_t, 1 << HASH_BITS> table = []
     {
-    }
-    else
-        throw std::runtime_error("Unhandled code");
+        std::array<uint8_t, 1 << HASH_BITS> table;
+        table.fill(NO_CODE);
+        for (size_t index = 0; index < sizeof(CODES) / sizeof(CODES[0]); ++index)
+            table[hashMnemonic(packMnemonic(CODES[index].m_mnemonic))] = index;
+        return table;
+    }();
+    return table;
+}
+
+const CodeInfo &codeInfo(Code code)
+{
+    return CODES[static_cast<size_t>(code)];
+}
+
+bool findCode(Slice mnemonic, Code &code)
+{
+    if ((mnemonic.m_size < 3) || (mnemonic.m_size > 4))
+        return false;
+
+    char packed[4] = {};
+    memcpy(packed, mnemonic.m_data, mnemonic.m_size);
+    const uint8_t index = hashTable()[hashMnemonic(packMnemonic(packed))];
+    if ((index == NO_CODE) || (strncmp(CODES[index].m_mnemonic, packed, 4) != 0))
+        return false;
+
+    code = static_cast<Code>(index);
+    return true;
+}
+
+Value::Value(Code code)
+    : m_code(code)
+    , m_parser(codeInfo(code).m_parser)
+{
+    m_fvalue.m_factor = codeInfo(code).m_factor;
+    m_fvalue.m_value = 0.f;
 
     // the converter value is 3% lower than the reference value from the
     // electric meter
-    if ((m_code == "PAC") || (m_code == "KDY"))
+    if ((m_code == Code::CODE_PAC) || (m_code == Code::CODE_KDY))
     {
         m_fvalue.m_factor *= 1.03f;
     }
 }
 
+static Code lookupCode(const std::string &mnemonic)
+{
+    Code code;
+    if (!findCode(Slice(mnemonic.data(), mnemonic.size()), code))
+        throw std::runtime_error("Unhandled code " + mnemonic);
+    return code;
+}
+
+Value::Value(const std::string &mnemonic)
+    : Value(lookupCode(mnemonic))
+{
+}
+
 Value::~Value()
 {
 
 }
 
-void Value::parse(const std::string &string)
+// Split 'string' at the first 'separator', returns the part before it and sets 'string' to the part after it
+static Slice next(Slice &string, char separator)
 {
-    if (m_code.compare(0, 2, "DD") == 0)
+    const char *end = static_cast<const char*>(memchr(string.m_data, separator, string.m_size));
+    if (!end)
     {
-        // YYYMMDD,kWh,max,h
-        uint32_t year, month, day, power, max, hours;
+        const Slice head = string;
+        string = Slice(string.m_data + string.m_size, 0);
+        return head;
+    }
 
-        size_t index = 0;
-        std::istringstream(string.substr(index, 3)) >> std::hex >> year;
-        index += 3;
-        std::istringstream(string.substr(index, 2)) >> std::hex >> month;
-        index += 2;
-        std::istringstream(string.substr(index, 2)) >> std::hex >> day;
-        index += 2;
-        if (string[index] != ',')
-            return;
-        ++index;
+    const Slice head(string.m_data, end - string.m_data);
+    string = Slice(end + 1, string.m_size - head.m_size - 1);
+    return head;
+}
 
-        std::istringstream(string.substr(index)) >> std::hex >> power;
-        size_t newIndex = string.find_first_of(',', index);
-        if (newIndex == std::string::npos)
-            return;
-        index = newIndex + 1;
+// Decode the hex number in 'string', returns false if it is empty, too long or contains other characters
+static bool decodeHex(Slice string, uint32_t &value)
+{
+    if ((string.m_size == 0) || (string.m_size > 8))
+        return false;
 
-        std::istringstream(string.substr(index)) >> std::hex >> max;
-        newIndex = string.find_first_of(',', index);
-        if (newIndex == std::string::npos)
-            return;
-        index = newIndex + 1;
+    value = 0;
+    for (size_t index = 0; index < string.m_size; ++index)
+    {
+        const char c = string.m_data[index];
+        uint32_t digit;
+        if ((c >= '0') && (c <= '9'))
+            digit = c - '0';
+        else if ((c >= 'A') && (c <= 'F'))
+            digit = c - 'A' + 10;
+        else if ((c >= 'a') && (c <= 'f'))
+            digit = c - 'a' + 10;
+        else
+            return false;
+        value = (value << 4) | digit;
+    }
+    return true;
+}
 
-        std::istringstream(string.substr(index)) >> std::hex >> hours;
-        newIndex = string.find_first_of(',', index);
-        if (newIndex == std::string::npos)
-            return;
-        index = newIndex + 1;
+// Write 'value' as 'digits' upper case hex digits, returns the position after them
+static char *encodeHex(uint32_t value, size_t digits, char *output)
+{
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    for (size_t index = digits; index-- > 0; )
+    {
+        output[index] = HEX_DIGITS[value & 0xF];
+        value >>= 4;
+    }
+    return output + digits;
+}
+
+// sum of the characters from the source address to the '|' before the checksum
+static uint16_t checksum(const char *begin, const char *end)
+{
+    uint16_t sum = 0;
+    for (const char *c = begin; c != end; ++c)
+        sum += static_cast<unsigned char>(*c);
+    return sum;
+}
+
+bool Value::parse(Slice string)
+{
+    if (m_parser == Parser::STATISTIC)
+    {
+        // YYYMMDD,kWh,max,h
+        const Slice date = next(string, ',');
+        uint32_t year, month, day, power, max, hours;
+        if ((date.m_size != 7) ||
+            !decodeHex(Slice(date.m_data, 3), year) ||
+            !decodeHex(Slice(date.m_data + 3, 2), month) ||
+            !decodeHex(Slice(date.m_data + 5, 2), day) ||
+            !decodeHex(next(string, ','), power) ||
+            !decodeHex(next(string, ','), max) ||
+            !decodeHex(next(string, ','), hours))
+        {
+            return false;
+        }
 
         m_stat.m_year = year;
         m_stat.m_month = month;
@@ -100,212 +333,495 @@ void Value::parse(const std::string &string)
         m_stat.m_max = max;
         m_stat.m_hours = hours;
     }
-    else
+    else if (m_parser == Parser::ERROR)
     {
-        uint32_t ivalue = 0;
+        // YYYMMDD,seconds of the day,error code,...
+        const Slice date = next(string, ',');
+        uint32_t year, month, day, time, error;
+        if ((date.m_size != 7) ||
+            !decodeHex(Slice(date.m_data, 3), year) ||
+            !decodeHex(Slice(date.m_data + 3, 2), month) ||
+            !decodeHex(Slice(date.m_data + 5, 2), day) ||
+            !decodeHex(next(string, ','), time) ||
+            !decodeHex(next(string, ','), error))
+        {
+            return false;
+        }
 
-        std::istringstream(string) >> std::hex >> ivalue;
+        m_fvalue.m_value = (float)error * m_fvalue.m_factor;
+    }
+    else
+    {
+        // values with several fields (e.g. SYS) are read up to the first ','
+        uint32_t ivalue;
+        if (!decodeHex(next(string, ','), ivalue))
+            return false;
         m_fvalue.m_value = (float)ivalue * m_fvalue.m_factor;
     }
+    return true;
 }
 
-static std::string buildMessage(std::vector<Value*> values, uint32_t dst)
+size_t encodeRequest(const std::vector<Value*> &values, uint32_t dst, char (&frame)[MAX_FRAME_SIZE])
 {
-    std::ostringstream data;
+    // {FB;XX;LL|64:code;code|CCCC}
+    size_t dataSize = 0;
+    for (auto&& value: values)
+        dataSize += ((dataSize != 0) ? 1 : 0) + strlen(value->mnemonic());
+    const size_t size = FRAME_OVERHEAD + dataSize;
+    if (size > MAX_FRAME_SIZE)
+        return 0;
+
+    char *output = frame;
+    *output++ = '{';
+    output = encodeHex(MASTER_ADDRESS, 2, output);
+    *output++ = ';';
+    output = encodeHex(dst, 2, output);
+    *output++ = ';';
+    output = encodeHex(size, 2, output);
+    memcpy(output, "|64:", 4);
+    output += 4;
 
     bool first = true;
     for (auto&& value: values)
     {
         if (!first)
-            data << ";";
+            *output++ = ';';
         first = false;
-        data << value->code();
+        const size_t size = strlen(value->mnemonic());
+        memcpy(output, value->mnemonic(), size);
+        output += size;
     }
+    *output++ = '|';
+
+    output = encodeHex(checksum(frame + 1, output), 4, output);
+    *output++ = '}';
 
-    const uint32_t src = 0xFB;
-    const size_t len =
-          1 // '{'
-        + 2 // 'FB' - source address (hex)
-        + 1 // ';'
-        + 2 // 'XX' - destination address (hex)
-        + 1 // ';'
-        + 2 // 'XX' - message length (complete message) (hex)
-        + 4 // '|64:'
-        + data.str().length() // data, codes separated by ';'
-        + 1 // '|'
-        + 4 // 'XXXX' - checksum (from source address to last char before checksum) (hex)
-        + 1;// '}'
-
-    std::ostringstream checksumMsg;
-    checksumMsg <<
-        std::setfill('0') << std::hex << std::uppercase << std::setw(2) << src << ";" <<
-        std::setfill('0') << std::hex << std::uppercase << std::setw(2) << dst << ";" <<
-        std::setfill('0') << std::hex << std::uppercase << std::setw(2) << len << "|64:" <<
-        data.str() << "|";
-
-    uint16_t checksum = 0;
-    for (auto&& c: checksumMsg.str())
+    return size;
+}
+
+void parseReply(uint32_t src, Slice frame, const std::vector<Value*> &values)
+{
+    // {XX;FB;LL|64:code=value;code=value|CCCC}
+    const char *data = frame.m_data;
+    const size_t size = frame.m_size;
+    uint32_t from, to, length, sum;
+    if ((size < FRAME_OVERHEAD) || (data[0] != '{') || (data[size - 1] != '}') ||
+        !decodeHex(Slice(data + 1, 2), from) || (data[3] != ';') ||
+        !decodeHex(Slice(data + 4, 2), to) || (data[6] != ';') ||
+        !decodeHex(Slice(data + 7, 2), length) || (memcmp(data + 9, "|64:", 4) != 0) ||
+        (data[size - 6] != '|') || !decodeHex(Slice(data + size - 5, 4), sum))
     {
-        checksum += c;
+        throw std::runtime_error("Unexpected reply");
     }
 
-    std::ostringstream msg;
-    msg <<
-        "{" << checksumMsg.str() <<
-        std::setfill('0') << std::hex << std::uppercase << std::setw(4) << checksum << "}";
+    if ((from != src) || (to != MASTER_ADDRESS))
+        throw std::runtime_error("Unexpected reply, wrong address");
+    if (length != size)
+        throw std::runtime_error("Unexpected reply, wrong length");
+    if (sum != checksum(data + 1, data + size - 5))
+        throw std::runtime_error("Unexpected reply, wrong checksum");
 
-    return msg.str();
+    Slice items(data + 13, size - FRAME_OVERHEAD);
+    for (auto&& value: values)
+    {
+        Slice item = next(items, ';');
+        Code code;
+        if (!findCode(next(item, '='), code) || (code != value->code()))
+            throw std::runtime_error(std::string("Unexpected reply, expected ") + value->mnemonic());
+        if (!value->parse(item))
+            throw std::runtime_error(std::string("Unexpected reply, invalid value for ") + value->mnemonic());
+    }
 }
 
-static void parseReply(uint32_t src, const std::string &reply, const std::vector<Value*> values)
+Client::Client()
+    : m_stop(false)
+    , m_epoll(-1)
+    , m_wakeup(-1)
+    , m_socket(-1)
+    , m_connecting(false)
+    , m_failed(false)
+    , m_retryDelay(MIN_RETRY_DELAY)
 {
-    const uint32_t dst = 0xFB;
-    std::ostringstream expected;
-    expected <<
-        "{" <<
-        std::setfill('0') << std::hex << std::uppercase << std::setw(2) << src << ";" <<
-        std::setfill('0') << std::hex << std::uppercase << std::setw(2) << dst << ";";
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0)
+        throw std::runtime_error(std::string("epoll_create1() failed: ") + strerror(errno));
 
-    size_t index = 0;
-    if (reply.compare(index, expected.str().length(), expected.str()) != 0)
-        throw std::runtime_error("Unexpected reply");
-    index += expected.str().length();
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup < 0)
+    {
+        ::close(m_epoll);
+        throw std::runtime_error(std::string("eventfd() failed: ") + strerror(errno));
+    }
 
-    // length
-    index += 2;
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = m_wakeup;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event) < 0)
+    {
+        const int error = errno;
+        ::close(m_wakeup);
+        ::close(m_epoll);
+        throw std::runtime_error(std::string("epoll_ctl() failed: ") + strerror(error));
+    }
 
-    // '|64:'
-    std::string delimiter("|64:");
-    if (reply.compare(index, delimiter.length(), delimiter) != 0)
-        throw std::runtime_error("Unexpected reply");
-    index += delimiter.length();
+    m_thread = std::thread(&Client::loop, this);
+}
+
+Client::~Client()
+{
+    m_stop = true;
+    const uint64_t one = 1;
+    if (::write(m_wakeup, &one, sizeof(one)) < 0)
+        Log(ERROR) << "Solar: Failed to wake up the event loop";
+    m_thread.join();
+
+    disconnect();
+    for (auto &&pending : m_queued)
+        pending.m_done.set_value(false);
+
+    ::close(m_wakeup);
+    ::close(m_epoll);
+}
+
+std::future<bool> Client::ask(Request &request, std::chrono::milliseconds timeout)
+{
+    Pending pending;
+    pending.m_request = &request;
+    pending.m_deadline = std::chrono::steady_clock::now() + timeout;
+    std::future<bool> done = pending.m_done.get_future();
 
-    for (auto&& value: values)
     {
-        // check for code
-        const std::string codeStr = value->code();
-        if (reply.compare(index, codeStr.length(), codeStr) != 0)
-            throw std::runtime_error("Unexpected reply");
-        index += codeStr.length();
-
-        // skip the '='
-        if (reply[index] != '=')
-            throw std::runtime_error("Unexpected reply");
-        index++;
-
-        // get the value
-        value->parse(reply.substr(index));
-
-        // skip ';'
-        size_t newIndex = reply.find_first_of(';', index);
-        if (newIndex == std::string::npos)
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failed)
         {
-            newIndex = reply.find_first_of('|', index);
-            if (newIndex == std::string::npos)
-                throw std::runtime_error("Unexpected reply, expected ';' or '|'");
+            pending.m_done.set_value(false);
+            return done;
         }
-        index = newIndex + 1;
+        m_queued.push_back(std::move(pending));
     }
+
+    const uint64_t one = 1;
+    if (::write(m_wakeup, &one, sizeof(one)) < 0)
+        Log(ERROR) << "Solar: Failed to wake up the event loop";
+
+    return done;
 }
 
-static int waitOnSocket(curl_socket_t sockfd, bool forRecv, long timeoutMs)
+void Client::loop()
 {
-    struct timeval tv;
-    fd_set infd, outfd, errfd;
-    int res;
+    while (!m_stop)
+    {
+        // wait until the next deadline
+        int timeoutMs = -1;
+        if (!m_inFlight.empty())
+        {
+            auto deadline = m_inFlight.front().m_deadline;
+            for (auto &&pending : m_inFlight)
+                deadline = std::min(deadline, pending.m_deadline);
+            timeoutMs = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count() + 1);
+        }
 
-    tv.tv_sec = timeoutMs / 1000;
-    tv.tv_usec= (timeoutMs % 1000) * 1000;
+        epoll_event events[2];
+        const int count = epoll_wait(m_epoll, events, 2, timeoutMs);
+        if ((count < 0) && (errno != EINTR))
+        {
+            Log(ERROR) << "Solar: epoll_wait() failed: " << strerror(errno);
+
+            // without the event loop no request would ever be answered, fail the pending and all further ones
+            disconnect();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &&pending : m_queued)
+                pending.m_done.set_value(false);
+            m_queued.clear();
+            m_failed = true;
+            break;
+        }
 
-    FD_ZERO(&infd);
-    FD_ZERO(&outfd);
-    FD_ZERO(&errfd);
+        for (int index = 0; index < count; ++index)
+        {
+            if (events[index].data.fd == m_wakeup)
+            {
+                uint64_t value;
+                if (::read(m_wakeup, &value, sizeof(value)) < 0)
+                    continue;
+
+                std::list<Pending> queued;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    queued.swap(m_queued);
+                }
+                auto pending = queued.begin();
+                while (pending != queued.end())
+                {
+                    char frame[MAX_FRAME_SIZE];
+                    const size_t size = encodeRequest(pending->m_request->m_values, pending->m_request->m_address,
+                        frame);
+                    if (size == 0)
+                    {
+                        Log(ERROR) << "Solar: Too many codes for one request to " << pending->m_request->m_address;
+                        pending->m_done.set_value(false);
+                        pending = queued.erase(pending);
+                        continue;
+                    }
+                    Log(DEBUG) << "Solar: Send " << Slice(frame, size);
+                    m_send.append(frame, size);
+                    ++pending;
+                }
+                m_inFlight.splice(m_inFlight.end(), queued);
+
+                if ((m_socket < 0) && !connect())
+                {
+                    // fail at once instead of waiting for the deadlines
+                    while (!m_inFlight.empty())
+                        complete(m_inFlight.begin(), false);
+                    m_send.clear();
+                }
+                else if (!m_connecting)
+                {
+                    flush();
+                }
+            }
+            else if (events[index].data.fd == m_socket)
+            {
+                // the result of connecting is reported as writable socket or as error
+                if (m_connecting)
+                {
+                    connected();
+                }
+                else if (events[index].events & (EPOLLERR | EPOLLHUP))
+                {
+                    int error = 0;
+                    socklen_t length = sizeof(error);
+                    getsockopt(m_socket, SOL_SOCKET, SO_ERROR, &error, &length);
+                    Log(ERROR) << "Solar: Connection lost, " << strerror(error);
+                    disconnect();
+                    continue;
+                }
+                if ((m_socket >= 0) && (events[index].events & EPOLLIN))
+                    receive();
+                if ((m_socket >= 0) && !m_connecting && (events[index].events & EPOLLOUT))
+                    flush();
+            }
+        }
 
-    FD_SET(sockfd, &errfd); /* always check for error */
+        expire();
+    }
+}
 
-    if(forRecv)
+bool Client::connect()
+{
+    if (std::chrono::steady_clock::now() < m_retryTime)
+        return false;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    inet_pton(AF_INET, IP_ADDR.c_str(), &address.sin_addr);
+
+    // the connection is established when the socket gets writable
+    m_connecting = true;
+    m_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if ((m_socket < 0) ||
+        ((::connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) && (errno != EINPROGRESS)))
     {
-        FD_SET(sockfd, &infd);
+        Log(ERROR) << "Solar: Connect failed, " << strerror(errno) << ", retry in " << m_retryDelay.count() << " s";
+        disconnect();
+        return false;
     }
-    else
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.fd = m_socket;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_socket, &event) < 0)
     {
-        FD_SET(sockfd, &outfd);
+        Log(ERROR) << "Solar: Failed to watch the connection, " << strerror(errno) << ", retry in "
+            << m_retryDelay.count() << " s";
+        disconnect();
+        return false;
     }
+    return true;
+}
 
-    /* select() returns the number of signalled sockets or -1 */
-    res = select(sockfd + 1, &infd, &outfd, &errfd, &tv);
-    return res;
+void Client::connected()
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(m_socket, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0)
+    {
+        Log(ERROR) << "Solar: Connect failed, " << strerror(error) << ", retry in " << m_retryDelay.count() << " s";
+        disconnect();
+        return;
+    }
+
+    Log(DEBUG) << "Solar: Connected";
+    m_connecting = false;
+    m_retryDelay = MIN_RETRY_DELAY;
+    watch();
 }
 
-bool askConverter(uint32_t address, std::vector<Value*> &values)
+// Close the connection and fail the requests in flight, their replies would get lost. A connection which had not
+// been established is retried after a delay.
+void Client::disconnect()
 {
-    bool success = true;
-    std::istringstream msg(buildMessage(values, address));
+    if (m_socket >= 0)
+    {
+        // a socket which failed to connect had not been added
+        if ((epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_socket, nullptr) < 0) && (errno != ENOENT))
+            Log(ERROR) << "Solar: Failed to stop watching the connection, " << strerror(errno);
+        ::close(m_socket);
+    }
+    if (m_connecting)
+    {
+        m_retryTime = std::chrono::steady_clock::now() + m_retryDelay;
+        m_retryDelay = std::min(m_retryDelay * 2, MAX_RETRY_DELAY);
+    }
+    m_socket = -1;
+    m_connecting = false;
+    m_send.clear();
+    m_received.clear();
 
-    Log(DEBUG) << "Solar: Send " << msg.str();
+    while (!m_inFlight.empty())
+        complete(m_inFlight.begin(), false);
+}
 
-    CURL *curl = nullptr;
-    try
+// wait for writability only while there is data to send
+void Client::watch()
+{
+    epoll_event event = {};
+    event.events = m_send.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT);
+    event.data.fd = m_socket;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, m_socket, &event) < 0)
     {
-        std::ostringstream reply;
-        CURLcode res;
-
-        curl = curl_easy_init();
-        if (!curl)
-            throw std::runtime_error("Could not init curl");
-
-        curl_easy_setopt(curl, CURLOPT_URL, IP_ADDR.c_str());
-        curl_easy_setopt(curl, CURLOPT_PORT, PORT);
-        curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
-
-        res = curl_easy_perform(curl);
-        if (res != CURLE_OK)
-            throw std::runtime_error(curl_easy_strerror(res));
-
-        curl_socket_t sockfd;
-        res = curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sockfd);
-        if (res != CURLE_OK)
-            throw std::runtime_error(curl_easy_strerror(res));
-
-        size_t nsent = 0;
-        res = curl_easy_send(curl, msg.str().c_str(), msg.str().size(), &nsent);
-        if (res != CURLE_OK)
-            throw std::runtime_error(curl_easy_strerror(res));
-
-        char buf[512];
-        size_t nread;
-        do
+        Log(ERROR) << "Solar: Failed to watch the connection, " << strerror(errno);
+        disconnect();
+    }
+}
+
+void Client::flush()
+{
+    while (!m_send.empty())
+    {
+        const ssize_t sent = ::send(m_socket, m_send.data(), m_send.size(), MSG_NOSIGNAL);
+        if (sent < 0)
         {
-            nread = 0;
-            res = curl_easy_recv(curl, buf, sizeof(buf), &nread);
-            if (res == CURLE_AGAIN)
-            {
-                if (!waitOnSocket(sockfd, true, 1000L))
-                    throw std::runtime_error("Timeout");
-            }
-            if (nread != 0)
-            {
-                buf[nread] = 0;
-                reply << buf;
-            }
-        } while (res == CURLE_AGAIN);
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                break;
+            Log(ERROR) << "Solar: Send failed, " << strerror(errno);
+            disconnect();
+            return;
+        }
+        m_send.erase(0, sent);
+    }
+    watch();
+}
+
+void Client::receive()
+{
+    char buf[512];
+    while (true)
+    {
+        const ssize_t nread = ::recv(m_socket, buf, sizeof(buf), 0);
+        if (nread < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                break;
+            Log(ERROR) << "Solar: Connection lost, " << strerror(errno);
+            disconnect();
+            return;
+        }
+        if (nread == 0)
+        {
+            Log(ERROR) << "Solar: Connection closed";
+            disconnect();
+            return;
+        }
+
+        // the replies are framed by '{' and '}'
+        m_received.append(buf, nread);
+        size_t start;
+        size_t end;
+        while (((start = m_received.find('{')) != std::string::npos) &&
+            ((end = m_received.find('}', start)) != std::string::npos))
+        {
+            dispatch(Slice(m_received.data() + start, end - start + 1));
+            m_received.erase(0, end + 1);
+        }
+
+        // bytes outside of a frame are dropped, a frame can't get longer than the size field allows
+        m_received.erase(0, m_received.find('{'));
+        if (m_received.size() > MAX_FRAME_SIZE)
+        {
+            Log(ERROR) << "Solar: Reply exceeds " << MAX_FRAME_SIZE << " bytes without end, reconnecting";
+            disconnect();
+            return;
+        }
+    }
+}
+
+// Assign a reply to the oldest request in flight to its source address which asked for the codes in the reply. A
+// late reply to a request which timed out is dropped that way unless the same codes are asked again.
+void Client::dispatch(Slice reply)
+{
+    Log(DEBUG) << "Solar: Reply " << reply;
 
-        if (res != CURLE_OK)
-            throw std::runtime_error(curl_easy_strerror(res));
+    uint32_t src = 0;
+    if ((reply.m_size < 3) || !decodeHex(Slice(reply.m_data + 1, 2), src))
+    {
+        Log(ERROR) << "Solar: Invalid reply " << reply;
+        return;
+    }
+
+    for (auto pending = m_inFlight.begin(); pending != m_inFlight.end(); ++pending)
+    {
+        if (pending->m_request->m_address != src)
+            continue;
+
+        try
+        {
+            parseReply(src, reply, pending->m_request->m_values);
+        }
+        catch (std::exception &)
+        {
+            continue;
+        }
+        complete(pending, true);
+        return;
+    }
 
-        Log(DEBUG) << "Solar: Reply " << reply.str();
+    Log(ERROR) << "Solar: Unexpected reply " << reply;
+}
 
-        parseReply(address, reply.str(), values);
+void Client::expire()
+{
+    const auto now = std::chrono::steady_clock::now();
+    bool expired = false;
+    auto pending = m_inFlight.begin();
+    while (pending != m_inFlight.end())
+    {
+        auto next = std::next(pending);
+        if (pending->m_deadline <= now)
+        {
+            Log(DEBUG) << "Solar: No reply from " << pending->m_request->m_address;
+            complete(pending, false);
+            expired = true;
+        }
+        pending = next;
     }
-    catch (std::exception &er)
+
+    // a connection which could not be established within the timeout is retried later
+    if (expired && m_connecting)
     {
-        Log(ERROR) << er.what();
-        success = false;
+        Log(ERROR) << "Solar: Connect timed out, retry in " << m_retryDelay.count() << " s";
+        disconnect();
     }
-    if (curl)
-        curl_easy_cleanup(curl);
+}
 
-    return success;
+void Client::complete(std::list<Pending>::iterator pending, bool success)
+{
+    pending->m_done.set_value(success);
+    m_inFlight.erase(pending);
 }
 
 } // namespace SolarMax
@@ -1,23 +1,192 @@
 #ifndef SOLARMAX_H
 #define SOLARMAX_H
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <list>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace SolarMax
 {
 
+// a part of a frame, parsing works on slices of the received data instead of copies
+struct Slice
+{
+    Slice(const char *data, size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    const char *m_data;
+    size_t m_size;
+};
+
+inline std::ostream &operator<<(std::ostream &stream, const Slice &slice)
+{
+    return stream.write(slice.m_data, slice.m_size);
+}
+
+// the values of the converters, the mnemonic on the wire is the name without CODE_
+enum class Code : uint8_t
+{
+    CODE_ADR,   // Address
+    CODE_TYP,   // Type
+    CODE_SWV,   // Software version
+    CODE_DDY,   // Date day
+    CODE_DMT,   // Date month
+    CODE_DYR,   // Date year
+    CODE_THR,   // Time hours
+    CODE_TMI,   // Time minutes
+    CODE_E11,   // Error 1, number
+    CODE_E1D,   // Error 1, day
+    CODE_E1M,   // Error 1, month
+    CODE_E1h,   // Error 1, hour
+    CODE_E1m,   // Error 1, minute
+    CODE_E21,   // Error 2, number
+    CODE_E2D,   // Error 2, day
+    CODE_E2M,   // Error 2, month
+    CODE_E2h,   // Error 2, hour
+    CODE_E2m,   // Error 2, minute
+    CODE_E31,   // Error 3, number
+    CODE_E3D,   // Error 3, day
+    CODE_E3M,   // Error 3, month
+    CODE_E3h,   // Error 3, hour
+    CODE_E3m,   // Error 3, minute
+    CODE_KHR,   // Operating hours
+    CODE_KDY,   // Energy today [kWh]
+    CODE_KLD,   // Energy last day [kWh]
+    CODE_KMT,   // Energy this month [kWh]
+    CODE_KLM,   // Energy last month [kWh]
+    CODE_KYR,   // Energy this year [kWh]
+    CODE_KLY,   // Energy last year [kWh]
+    CODE_KT0,   // Energy total [kWh]
+    CODE_LAN,   // Language
+    CODE_UDC,   // DC voltage [V]
+    CODE_UL1,   // AC voltage [V]
+    CODE_IDC,   // DC current [A]
+    CODE_IL1,   // AC current [A]
+    CODE_PAC,   // AC power [W]
+    CODE_PIN,   // Power installed [W]
+    CODE_PRL,   // AC power [%]
+    CODE_CAC,   // Start ups
+    CODE_FRD,   // ???
+    CODE_SCD,   // ???
+    CODE_SE1,   // ???
+    CODE_SE2,   // ???
+    CODE_SPR,   // ???
+    CODE_TKK,   // Temperature Heat Sink
+    CODE_TNF,   // Net frequency (Hz)
+    CODE_SYS,   // Operation State
+    CODE_BDN,   // Build number
+    CODE_EC00,  // Error-Code(?) 00
+    CODE_EC01,  // Error-Code(?) 01
+    CODE_EC02,  // Error-Code(?) 02
+    CODE_EC03,  // Error-Code(?) 03
+    CODE_EC04,  // Error-Code(?) 04
+    CODE_EC05,  // Error-Code(?) 05
+    CODE_EC06,  // Error-Code(?) 06
+    CODE_EC07,  // Error-Code(?) 07
+    CODE_EC08,  // Error-Code(?) 08
+    CODE_DD00,  // Statistic Day 0 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD01,  // Statistic Day 1 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD02,  // Statistic Day 2 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD03,  // Statistic Day 3 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD04,  // Statistic Day 4 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD05,  // Statistic Day 5 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD06,  // Statistic Day 6 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD07,  // Statistic Day 7 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD08,  // Statistic Day 8 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD09,  // Statistic Day 9 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD10,  // Statistic Day 10 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD11,  // Statistic Day 11 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD12,  // Statistic Day 12 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD13,  // Statistic Day 13 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD14,  // Statistic Day 14 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD15,  // Statistic Day 15 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD16,  // Statistic Day 16 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD17,  // Statistic Day 17 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD18,  // Statistic Day 18 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD19,  // Statistic Day 19 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD20,  // Statistic Day 20 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD21,  // Statistic Day 21 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD22,  // Statistic Day 22 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD23,  // Statistic Day 23 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD24,  // Statistic Day 24 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD25,  // Statistic Day 25 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD26,  // Statistic Day 26 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD27,  // Statistic Day 27 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD28,  // Statistic Day 28 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD29,  // Statistic Day 29 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DD30,  // Statistic Day 30 YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM00,  // Statistic Month 0 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM01,  // Statistic Month 1 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM02,  // Statistic Month 2 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM03,  // Statistic Month 3 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM04,  // Statistic Month 4 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM05,  // Statistic Month 5 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM06,  // Statistic Month 6 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM07,  // Statistic Month 7 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM08,  // Statistic Month 8 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM09,  // Statistic Month 9 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM10,  // Statistic Month 10 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DM11,  // Statistic Month 11 YYYMM00,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY00,  // Statistic Year 0 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY01,  // Statistic Year 1 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY02,  // Statistic Year 2 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY03,  // Statistic Year 3 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY04,  // Statistic Year 4 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY05,  // Statistic Year 5 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY06,  // Statistic Year 6 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY07,  // Statistic Year 7 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY08,  // Statistic Year 8 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_DY09,  // Statistic Year 9 YYY0000,Yield kWh*10,Peak W*2,Hours*10
+    CODE_COUNT
+};
+
+// how the value of a code is read
+enum class Parser : uint8_t
+{
+    SCALAR,     // a hex number, only the first field of values with several fields
+    STATISTIC,  // YYYMMDD,Yield kWh*10,Peak W*2,Hours*10
+    ERROR       // YYYMMDD,Seconds of the day,Error code,..., the value is the error code
+};
+
+struct CodeInfo
+{
+    const char *m_mnemonic;
+    float m_factor;     // applied to scalar values
+    Parser m_parser;
+};
+
+const CodeInfo &codeInfo(Code code);
+
+// Find the code with the given mnemonic, returns false if it is unknown
+bool findCode(Slice mnemonic, Code &code);
+
 class Value
 {
 public:
-    Value(const std::string &code);
+    Value(Code code);
+    // throws if 'mnemonic' is not a known code
+    Value(const std::string &mnemonic);
     ~Value();
 
-    const std::string &code() const
+    Code code() const
     {
         return m_code;
     }
 
+    const char *mnemonic() const
+    {
+        return codeInfo(m_code).m_mnemonic;
+    }
+
     float value() const
     {
         return m_fvalue.m_value;
@@ -28,10 +197,12 @@ public:
         return m_stat.m_max;
     }
 
-    void parse(const std::string &value);
+    // returns false if 'value' is not valid for the code
+    bool parse(Slice value);
 
 private:
-    std::string m_code;
+    Code m_code;
+    Parser m_parser;
     union
     {
         struct
@@ -51,7 +222,77 @@ private:
     };
 };
 
-bool askConverter(uint32_t address, std::vector<Value*> &values);
+// the length field has two hex digits
+static const size_t MAX_FRAME_SIZE = 0xFF;
+
+// Encode the request for 'values' to the converter 'dst' into 'frame', returns the length of the frame or 0 if the
+// codes do not fit into one frame
+size_t encodeRequest(const std::vector<Value*> &values, uint32_t dst, char (&frame)[MAX_FRAME_SIZE]);
+
+// Parse the reply 'frame' of the converter 'src' to the request for 'values', throws if the frame is invalid
+void parseReply(uint32_t src, Slice frame, const std::vector<Value*> &values);
+
+// the values to read from the converter with the given address
+struct Request
+{
+    uint32_t m_address;
+    std::vector<Value*> m_values;
+};
+
+/**
+ * Client for the converters behind the gateway. The connection is kept open and served by an event loop on its own
+ * thread, so requests to several converters are in flight at the same time and a converter which does not reply
+ * only delays its own request. Replies are assigned to the requests by their source address. A failed connection is
+ * retried with increasing delays.
+ */
+class Client
+{
+public:
+    Client();
+    ~Client();
+
+    // Send 'request', the future is set to true when the converter replied and to false if there was no reply until
+    // the timeout. 'request' needs to be kept until then, its values are set by the event loop.
+    std::future<bool> ask(Request &request, std::chrono::milliseconds timeout);
+
+private:
+    struct Pending
+    {
+        Request *m_request;
+        std::chrono::steady_clock::time_point m_deadline;
+        std::promise<bool> m_done;
+    };
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    int m_epoll;
+    int m_wakeup;
+    int m_socket;
+    bool m_connecting;
+
+    // requests handed over to the event loop, none are accepted after the event loop failed
+    std::mutex m_mutex;
+    std::list<Pending> m_queued;
+    bool m_failed;
+
+    // event loop state
+    std::list<Pending> m_inFlight;
+    std::string m_send;
+    std::string m_received;
+    std::chrono::steady_clock::time_point m_retryTime;
+    std::chrono::seconds m_retryDelay;
+
+    void loop();
+    bool connect();
+    void connected();
+    void disconnect();
+    void watch();
+    void flush();
+    void receive();
+    void dispatch(Slice reply);
+    void expire();
+    void complete(std::list<Pending>::iterator pending, bool success);
+};
 
 } // namespace SolarMax
 
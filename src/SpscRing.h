@@ -0,0 +1,61 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Lock-free ring buffer for exactly one producer and one consumer thread. The elements are allocated once and
+ * filled in place, so neither side allocates memory or blocks.
+ */
+template <typename T>
+class SpscRing {
+   public:
+    explicit SpscRing(size_t capacity) : m_slots(capacity), m_head(0), m_tail(0) {}
+
+    size_t capacity() const { return m_slots.size(); }
+
+    /**
+     * Producer: the slot to fill next, nullptr if the ring is full. The element is published with push().
+     */
+    T *back() {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= m_slots.size()) return nullptr;
+        return &m_slots[head % m_slots.size()];
+    }
+    void push() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /**
+     * Consumer: the oldest element (or the one 'offset' after it), nullptr if the ring holds no such element. The
+     * elements are released with pop().
+     */
+    T *front(size_t offset = 0) {
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail + offset >= m_head.load(std::memory_order_acquire)) return nullptr;
+        return &m_slots[(tail + offset) % m_slots.size()];
+    }
+    void pop(size_t count = 1) {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    /**
+     * Consumer: release all elements
+     */
+    void flush() { m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release); }
+
+   private:
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    std::vector<T> m_slots;
+
+    // producer and consumer position on separate cache lines (padded, over-aligned new needs C++17)
+    char m_padding0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> m_head;
+    char m_padding1[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> m_tail;
+    char m_padding2[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+#endif  // SPSC_RING_H
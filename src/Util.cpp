@@ -1,6 +1,10 @@
 #include "Util.h"
 
 #include <sys/time.h>
+#include <time.h>
+
+// readings taken by ClockMapping::calibrate()
+static const int CALIBRATION_TRIES = 5;
 
 timeValueUs time()
 {
@@ -10,3 +14,42 @@ timeValueUs time()
 
     return (timeValueUs)tv.tv_sec * 1000000 + (timeValueUs)tv.tv_usec;
 }
+
+timeValueUs monotonicTime()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+    return (timeValueUs)ts.tv_sec * 1000000 + (timeValueUs)ts.tv_nsec / 1000;
+}
+
+ClockMapping& ClockMapping::getInstance()
+{
+    static ClockMapping instance;
+    return instance;
+}
+
+ClockMapping::ClockMapping()
+    : m_offsetUs(0)
+    , m_uncertaintyUs(0)
+{
+    calibrate();
+}
+
+void ClockMapping::calibrate()
+{
+    timeValueUs bestIntervalUs = UINT64_MAX;
+    for (int index = 0; index < CALIBRATION_TRIES; ++index)
+    {
+        const timeValueUs beforeUs = monotonicTime();
+        const timeValueUs wallUs = time();
+        const timeValueUs afterUs = monotonicTime();
+        if (afterUs - beforeUs < bestIntervalUs)
+        {
+            bestIntervalUs = afterUs - beforeUs;
+            m_offsetUs = (int64_t)wallUs - (int64_t)(beforeUs + bestIntervalUs / 2);
+        }
+    }
+    m_uncertaintyUs = (bestIntervalUs + 1) / 2;
+}
@@ -5,6 +5,40 @@
 
 using timeValueUs = uint64_t;
 
+// Wall clock time (us since the epoch) for the timestamps of published values. It steps when NTP sets the clock.
 timeValueUs time();
 
+// Time (us) of CLOCK_MONOTONIC_RAW for sample times and intervals. It is neither stepped nor slewed by NTP.
+timeValueUs monotonicTime();
+
+/**
+ * Maps the monotonic time to the wall clock. calibrate() reads the wall clock between two readings of the monotonic
+ * clock and keeps the closest of a few tries. The mapping is only updated by calibrate(), so an NTP step shows up
+ * between two calibrations and not within a measurement.
+ */
+class ClockMapping
+{
+public:
+    static ClockMapping& getInstance();
+
+    void calibrate();
+
+    timeValueUs toWall(timeValueUs monotonicUs) const
+    {
+        return monotonicUs + m_offsetUs;
+    }
+
+    // the mapping is off by at most this
+    timeValueUs uncertainty() const
+    {
+        return m_uncertaintyUs;
+    }
+
+private:
+    ClockMapping();
+
+    int64_t m_offsetUs;
+    timeValueUs m_uncertaintyUs;
+};
+
 #endif // TIME_H
@@ -0,0 +1,58 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(size_t workers)
+    : m_generation(0), m_stop(false), m_busy(0), m_task(nullptr), m_count(0), m_next(0) {
+    for (size_t index = 0; index < workers; ++index) m_threads.emplace_back(&WorkerPool::threadFunction, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (auto &&thread : m_threads) thread.join();
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t)> &task) {
+    if (m_threads.empty() || (count < 2)) {
+        for (size_t index = 0; index < count; ++index) task(index);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_threads.size();
+        ++m_generation;
+    }
+    m_start.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this] { return m_busy == 0; });
+    m_task = nullptr;
+}
+
+void WorkerPool::work() {
+    for (size_t index = m_next++; index < m_count; index = m_next++) (*m_task)(index);
+}
+
+void WorkerPool::threadFunction() {
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_start.wait(lock, [&] { return m_stop || (m_generation != generation); });
+        if (m_stop) return;
+        generation = m_generation;
+
+        lock.unlock();
+        work();
+        lock.lock();
+
+        if (--m_busy == 0) m_finished.notify_one();
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of threads working on independent tasks. The tasks of one run() are taken from a shared counter, so
+ * a thread which is done early takes the next task instead of waiting for the others.
+ */
+class WorkerPool {
+   public:
+    // with no workers run() calls all tasks on the calling thread
+    explicit WorkerPool(size_t workers);
+    ~WorkerPool();
+
+    size_t workers() const { return m_threads.size(); }
+
+    /**
+     * Call task(index) for each index in [0, count) on the workers and the calling thread, returns when all tasks
+     * are done
+     */
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+   private:
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_finished;
+    // incremented with each run(), wakes the workers
+    uint64_t m_generation;
+    bool m_stop;
+    // workers still busy with the current run()
+    size_t m_busy;
+
+    const std::function<void(size_t)> *m_task;
+    size_t m_count;
+    std::atomic<size_t> m_next;
+
+    void threadFunction();
+    void work();
+};
+
+#endif  // WORKER_POOL_H